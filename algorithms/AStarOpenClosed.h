@@ -32,12 +32,34 @@
 #include <vector>
 #include <ext/hash_map>
 #include <stdint.h>
+#include "EpochIndexTable.h"
 
 struct AHash64 {
 	size_t operator()(const uint64_t &x) const
 	{ return (size_t)(x); }
 };
 
+/**
+ * The original hash_map index. Reset() has to free every node, which is why
+ * EpochIndexTable is the default.
+ */
+class AStarHashMapIndex {
+public:
+	void Clear() { table.clear(); }
+	bool Find(uint64_t key, uint64_t &value) const
+	{
+		IndexTable::const_iterator it = table.find(key);
+		if (it == table.end())
+			return false;
+		value = (*it).second;
+		return true;
+	}
+	void Insert(uint64_t key, uint64_t value) { table[key] = value; }
+private:
+	typedef __gnu_cxx::hash_map<uint64_t, uint64_t, AHash64> IndexTable;
+	IndexTable table;
+};
+
 enum dataLocation {
 	kOpenList,
 	kClosedList,
@@ -61,7 +83,7 @@ public:
 	dataLocation where;
 };
 
-template<typename state, typename CmpKey, class dataStructure = AStarOpenClosedData<state> >
+template<typename state, typename CmpKey, class dataStructure = AStarOpenClosedData<state>, class indexTable = EpochIndexTable >
 class AStarOpenClosed {
 public:
 	AStarOpenClosed();
@@ -90,29 +112,28 @@ private:
 
 	std::vector<uint64_t> theHeap;
 	// storing the element id; looking up with...hash?
-	typedef __gnu_cxx::hash_map<uint64_t, uint64_t, AHash64> IndexTable;
-	IndexTable table;
+	indexTable table;
 	std::vector<dataStructure > elements;
 };
 
 
-template<typename state, typename CmpKey, class dataStructure>
-AStarOpenClosed<state, CmpKey, dataStructure>::AStarOpenClosed()
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::AStarOpenClosed()
 {
 }
 
-template<typename state, typename CmpKey, class dataStructure>
-AStarOpenClosed<state, CmpKey, dataStructure>::~AStarOpenClosed()
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::~AStarOpenClosed()
 {
 }
 
 /**
  * Remove all objects from queue.
  */
-template<typename state, typename CmpKey, class dataStructure>
-void AStarOpenClosed<state, CmpKey, dataStructure>::Reset(int)
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+void AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::Reset(int)
 {
-	table.clear();
+	table.Clear();
 	elements.clear();
 	theHeap.resize(0);
 }
@@ -120,11 +141,12 @@ void AStarOpenClosed<state, CmpKey, dataStructure>::Reset(int)
 /**
  * Add object into open list.
  */
-template<typename state, typename CmpKey, class dataStructure>
-uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent)
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+uint64_t AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent)
 {
 	// should do lookup here...
-	if (table.find(hash) != table.end())
+	uint64_t existing;
+	if (table.Find(hash, existing))
 	{
 		//return -1; // TODO: find correct id and return
 		assert(false);
@@ -132,7 +154,7 @@ uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::AddOpenNode(const state
 	elements.push_back(dataStructure(val, g, h, parent, theHeap.size(), kOpenList));
 	if (parent == kTAStarNoNode)
 		elements.back().parentID = elements.size()-1;
-	table[hash] = elements.size()-1; // hashing to element list location
+	table.Insert(hash, elements.size()-1); // hashing to element list location
 	theHeap.push_back(elements.size()-1); // adding element id to back of heap
 	HeapifyUp(theHeap.size()-1); // heapify from back of the heap
 	return elements.size()-1;
@@ -141,23 +163,24 @@ uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::AddOpenNode(const state
 /**
  * Add object into closed list.
  */
-template<typename state, typename CmpKey, class dataStructure>
-uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent)
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+uint64_t AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent)
 {
 	// should do lookup here...
-	assert(table.find(hash) == table.end());
+	uint64_t existing;
+	assert(!table.Find(hash, existing));
 	elements.push_back(dataStructure(val, g, h, parent, 0, kClosedList));
 	if (parent == kTAStarNoNode)
 		elements.back().parentID = elements.size()-1;
-	table[hash] = elements.size()-1; // hashing to element list location
+	table.Insert(hash, elements.size()-1); // hashing to element list location
 	return elements.size()-1;
 }
 
 /**
  * Indicate that the key for a particular object has changed.
  */
-template<typename state, typename CmpKey, class dataStructure>
-void AStarOpenClosed<state, CmpKey, dataStructure>::KeyChanged(uint64_t val)
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+void AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::KeyChanged(uint64_t val)
 {
 //	EqKey eq;
 //	assert(eq(theHeap[table[val]], val));
@@ -170,8 +193,8 @@ void AStarOpenClosed<state, CmpKey, dataStructure>::KeyChanged(uint64_t val)
 ///**
 // * Indicate that the key for a particular object has increased.
 // */
-//template<typename state, typename CmpKey, class dataStructure>
-//void AStarOpenClosed<state, CmpKey, dataStructure>::IncreaseKey(uint64_t val)
+//template<typename state, typename CmpKey, class dataStructure, class indexTable>
+//void AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::IncreaseKey(uint64_t val)
 //{
 ////	EqKey eq;
 ////	assert(eq(theHeap[table[val]], val));
@@ -182,16 +205,11 @@ void AStarOpenClosed<state, CmpKey, dataStructure>::KeyChanged(uint64_t val)
 /**
  * Returns location of object as well as object key.
  */
-template<typename state, typename CmpKey, class dataStructure>
-dataLocation AStarOpenClosed<state, CmpKey, dataStructure>::Lookup(uint64_t hashKey, uint64_t &objKey) const
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+dataLocation AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::Lookup(uint64_t hashKey, uint64_t &objKey) const
 {
-	typename IndexTable::const_iterator it;
-	it = table.find(hashKey);
-	if (it != table.end())
-	{
-		objKey = (*it).second;
+	if (table.Find(hashKey, objKey))
 		return elements[objKey].where;
-	}
 	return kNotFound;
 }
 
@@ -199,8 +217,8 @@ dataLocation AStarOpenClosed<state, CmpKey, dataStructure>::Lookup(uint64_t hash
 /**
  * Peek at the next item to be expanded.
  */
-template<typename state, typename CmpKey, class dataStructure>
-uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::Peek() const
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+uint64_t AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::Peek() const
 {
 	assert(OpenSize() != 0);
 	
@@ -210,8 +228,8 @@ uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::Peek() const
 /**
  * Move the given item to the closed list and return key.
  */
-template<typename state, typename CmpKey, class dataStructure>
-uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::Close(uint64_t objKey)
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+uint64_t AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::Close(uint64_t objKey)
 {
 	assert(OpenSize() != 0);
 	uint64_t index = elements[objKey].openLocation;
@@ -229,8 +247,8 @@ uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::Close(uint64_t objKey)
 /**
  * Move the best item to the closed list and return key.
  */
-template<typename state, typename CmpKey, class dataStructure>
-uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::Close()
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+uint64_t AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::Close()
 {
 	assert(OpenSize() != 0);
 	
@@ -247,8 +265,8 @@ uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::Close()
 /**
  * Move item off the closed list and back onto the open list.
  */
-template<typename state, typename CmpKey, class dataStructure>
-void AStarOpenClosed<state, CmpKey, dataStructure>::Reopen(uint64_t objKey)
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+void AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::Reopen(uint64_t objKey)
 {
 	assert(elements[objKey].where == kClosedList);
 	elements[objKey].reopened = true;
@@ -262,8 +280,8 @@ void AStarOpenClosed<state, CmpKey, dataStructure>::Reopen(uint64_t objKey)
 ///**
 // * find this object in the Heap and return
 // */
-//template<typename state, typename CmpKey, class dataStructure>
-//OBJ AStarOpenClosed<state, CmpKey, dataStructure>::find(OBJ val)
+//template<typename state, typename CmpKey, class dataStructure, class indexTable>
+//OBJ AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::find(OBJ val)
 //{
 //	if (!IsIn(val))
 //		return OBJ();
@@ -273,8 +291,8 @@ void AStarOpenClosed<state, CmpKey, dataStructure>::Reopen(uint64_t objKey)
 ///**
 // * Returns true if no items are in the AStarOpenClosed.
 // */
-//template<typename state, typename CmpKey, class dataStructure>
-//bool AStarOpenClosed<state, CmpKey, dataStructure>::Empty()
+//template<typename state, typename CmpKey, class dataStructure, class indexTable>
+//bool AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::Empty()
 //{
 //	return theHeap.size() == 0;
 //}
@@ -282,8 +300,8 @@ void AStarOpenClosed<state, CmpKey, dataStructure>::Reopen(uint64_t objKey)
 ///**
 //* Verify that the Heap is internally consistent. Fails assertion if not.
 // */
-//template<typename state, typename CmpKey, class dataStructure>
-//void AStarOpenClosed<state, CmpKey, dataStructure>::verifyData()
+//template<typename state, typename CmpKey, class dataStructure, class indexTable>
+//void AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::verifyData()
 //{
 //	assert(theHeap.size() == table.size());
 //	AStarOpenClosed::IndexTable::iterator iter;
@@ -297,8 +315,8 @@ void AStarOpenClosed<state, CmpKey, dataStructure>::Reopen(uint64_t objKey)
 /**
  * Moves a node up the heap. Returns true if the node was moved, false otherwise.
  */
-template<typename state, typename CmpKey, class dataStructure>
-bool AStarOpenClosed<state, CmpKey, dataStructure>::HeapifyUp(unsigned int index)
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+bool AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::HeapifyUp(unsigned int index)
 {
 	if (index == 0) return false;
 	int parent = (index-1)/2;
@@ -317,8 +335,8 @@ bool AStarOpenClosed<state, CmpKey, dataStructure>::HeapifyUp(unsigned int index
 	return false;
 }
 
-template<typename state, typename CmpKey, class dataStructure>
-void AStarOpenClosed<state, CmpKey, dataStructure>::HeapifyDown(unsigned int index)
+template<typename state, typename CmpKey, class dataStructure, class indexTable>
+void AStarOpenClosed<state, CmpKey, dataStructure, indexTable>::HeapifyDown(unsigned int index)
 {
 	CmpKey compare;
 	unsigned int child1 = index*2+1;
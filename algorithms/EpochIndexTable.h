@@ -0,0 +1,147 @@
+/*
+ *  EpochIndexTable.h
+ *  hog2
+ *
+ *  Index table mapping state hashes to element ids for open/closed lists
+ *  that are reset between many short searches.
+ */
+
+#ifndef EPOCHINDEXTABLE_H
+#define EPOCHINDEXTABLE_H
+
+#include <cassert>
+#include <stddef.h>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * State hashes are often packed coordinates or ranks; mix the bits so that
+ * masking off the low bits still spreads keys over a power-of-two table.
+ * Shared by the linear-probe tables.
+ */
+inline uint64_t MixHashBits(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	return key;
+}
+
+/**
+ * Linear-probe open-addressing table whose slots are tagged with the epoch
+ * they were written in. Clear() only advances the epoch, so slots left from
+ * earlier searches read as free and the table keeps its capacity; all slots
+ * are only rewritten when the 16-bit epoch wraps around. The tag shares a
+ * word with the value, so slots stay 16 bytes and ids must be below 2^48.
+ * Capacity is always a power of two. Entries are never removed individually.
+ */
+class EpochIndexTable {
+public:
+	EpochIndexTable(size_t initialCapacity = 1024, double maxLoad = 0.5)
+	:count(0), epoch(1), maxLoad(maxLoad)
+	{ assert(maxLoad > 0 && maxLoad < 1); Rehash(initialCapacity); }
+
+	/** Remove all entries in O(1), keeping the current capacity. */
+	void Clear()
+	{
+		count = 0;
+		if (++epoch <= kMaxEpoch)
+			return;
+		for (auto &s : slots)
+			s.tagged = 0;
+		epoch = 1;
+	}
+	/** Make sure count entries can be inserted without rehashing. */
+	void Reserve(size_t numEntries)
+	{
+		size_t needed = (size_t)(numEntries/maxLoad)+1;
+		if (needed > slots.size())
+			Rehash(needed);
+	}
+	/** Resize the table to at least minCapacity slots and reinsert all entries. */
+	void Rehash(size_t minCapacity)
+	{
+		size_t newCapacity = 16;
+		while (newCapacity < minCapacity || newCapacity*maxLoad < count)
+			newCapacity <<= 1;
+		std::vector<slot> old;
+		old.swap(slots);
+		slots.resize(newCapacity);
+		mask = newCapacity-1;
+		growAt = (size_t)(newCapacity*maxLoad);
+		count = 0;
+		for (const auto &s : old)
+			if (Current(s))
+				Place(s.key, s.tagged&kValueMask);
+	}
+	size_t Size() const { return count; }
+	size_t Capacity() const { return slots.size(); }
+	size_t MemoryUsage() const { return slots.size()*sizeof(slot); }
+
+	bool Find(uint64_t key, uint64_t &value) const
+	{
+		for (size_t i = MixHashBits(key)&mask; ; i = (i+1)&mask)
+		{
+			const slot &s = slots[i];
+			if (!Current(s))
+				return false;
+			if (s.key == key)
+			{
+				value = s.tagged&kValueMask;
+				return true;
+			}
+		}
+	}
+	void Insert(uint64_t key, uint64_t value)
+	{
+		assert(value <= kValueMask);
+		if (count >= growAt)
+			Rehash(slots.size()*2);
+		Place(key, value);
+	}
+	/** Call f(key, value) for every entry. */
+	template <typename F>
+	void ForEach(F f) const
+	{
+		for (const auto &s : slots)
+			if (Current(s))
+				f(s.key, s.tagged&kValueMask);
+	}
+private:
+	static const int kEpochShift = 48;
+	static const uint64_t kValueMask = (1ull<<kEpochShift)-1;
+	static const uint64_t kMaxEpoch = 0xFFFF;
+	struct slot {
+		slot() :key(0), tagged(0) {}
+		uint64_t key;
+		uint64_t tagged; // epoch in the high 16 bits, value below
+	};
+	inline bool Current(const slot &s) const { return (s.tagged>>kEpochShift) == epoch; }
+	void Place(uint64_t key, uint64_t value)
+	{
+		for (size_t i = MixHashBits(key)&mask; ; i = (i+1)&mask)
+		{
+			slot &s = slots[i];
+			if (!Current(s))
+			{
+				s.key = key;
+				s.tagged = (epoch<<kEpochShift)|value;
+				count++;
+				return;
+			}
+			if (s.key == key)
+			{
+				s.tagged = (epoch<<kEpochShift)|value;
+				return;
+			}
+		}
+	}
+	std::vector<slot> slots;
+	size_t mask;
+	size_t count;
+	size_t growAt;
+	uint64_t epoch;
+	double maxLoad;
+};
+
+#endif
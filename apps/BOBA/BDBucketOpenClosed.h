@@ -0,0 +1,390 @@
+/*
+ *  BDBucketOpenClosed.h
+ *
+ *  Bucketed replacement for BDOpenClosed for domains where g and h are small
+ *  non-negative integers (unit-cost TOH, pancake, Rubik's cube). The ready
+ *  queue is bucketed by (g, f) and the waiting queue by (f, g), so the heap
+ *  operations become O(1) bucket pushes/pops. The order matches
+ *  BOBACompareOpenReady (low g, then low f) and BOBACompareOpenWaiting
+ *  (low f, then high g); ties inside a bucket are broken LIFO.
+ *
+ *  Costs are rounded to the nearest integer when choosing a bucket; this queue
+ *  must not be used with real-valued edge costs or heuristics.
+ */
+
+#ifndef BDBUCKETOPENCLOSED_H
+#define BDBUCKETOPENCLOSED_H
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+#include "BDOpenClosed.h"
+
+template<typename state, class dataStructure = BDOpenClosedData<state>, class indexTable = EpochIndexTable>
+class BDBucketOpenClosed {
+public:
+	BDBucketOpenClosed();
+	~BDBucketOpenClosed() {}
+	void Reset();
+	void Reserve(size_t count) { elements.reserve(count); buckets.reserve(count); table.Reserve(count); }
+	uint64_t AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent=kTBDNoNode, stateLocation whichQueue = kOpenWaiting);
+	uint64_t AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent=kTBDNoNode);
+	void KeyChanged(uint64_t objKey);
+	void Remove(uint64_t objKey);
+	stateLocation Lookup(uint64_t hashKey, uint64_t &objKey) const;
+	inline dataStructure &Lookup(uint64_t objKey) { return elements[objKey]; }
+	inline const dataStructure &Lookat(uint64_t objKey) const { return elements[objKey]; }
+	uint64_t Peek(stateLocation whichQueue) const;
+	uint64_t Close();
+	uint64_t PutToReady();
+	// moves are already O(1), so batches need no separate heap repair
+	uint64_t PutToReadyDeferred() { return PutToReady(); }
+	void RestoreReadyQueue() {}
+
+	size_t OpenReadySize() const { return openCount[kOpenReady]; }
+	size_t OpenWaitingSize() const { return openCount[kOpenWaiting]; }
+	size_t OpenSize() const { return openCount[kOpenReady]+openCount[kOpenWaiting]; }
+
+	size_t ClosedSize() const { return size()-OpenReadySize()-OpenWaitingSize(); }
+	size_t size() const { return elements.size(); }
+	bool LookupG(uint64_t hashKey, double &g) const;
+	size_t CompactClosed();
+	size_t CompactedSize() const { return compactedClosed.Size(); }
+	size_t MemoryUsage() const
+	{
+		size_t bucketBytes = 0;
+		for (int x = 0; x < 2; x++)
+			for (const auto &r : rows[x])
+				for (const auto &c : r.cols)
+					bucketBytes += c.capacity()*sizeof(uint64_t);
+		return elements.capacity()*sizeof(dataStructure)+buckets.capacity()*sizeof(bucketLocation)+
+		bucketBytes+table.MemoryUsage()+compactedClosed.MemoryUsage();
+	}
+private:
+	// (g, f) of the bucket an open node is stored in; kept separately because
+	// callers change g in place before calling KeyChanged
+	struct bucketLocation {
+		int g, f;
+	};
+	// one row of buckets per primary key (g for ready, f for waiting),
+	// indexed by the secondary key (f for ready, g for waiting)
+	struct bucketRow {
+		bucketRow() :count(0) {}
+		std::vector<std::vector<uint64_t>> cols;
+		uint64_t count;
+	};
+	static int ToBucket(double cost)
+	{
+		int result = (int)std::floor(cost+0.5);
+		assert(result >= 0 && std::fabs(cost-result) < 1e-6);
+		return result;
+	}
+	void Add(uint64_t objKey, stateLocation whichQueue);
+	void Unlink(uint64_t objKey);
+	void FindMin(stateLocation whichQueue) const;
+	std::vector<uint64_t> &Bucket(stateLocation whichQueue, int g, int f);
+
+	std::vector<bucketRow> rows[2];
+	uint64_t openCount[2];
+	// lower bound on the best non-empty bucket of each queue: (row, column)
+	mutable int minRow[2], minCol[2];
+
+	indexTable table;
+	// hashes of closed states that no longer have a record
+	BDCompactClosedSet compactedClosed;
+	std::vector<dataStructure> elements;
+	std::vector<bucketLocation> buckets;
+};
+
+template<typename state, class dataStructure, class indexTable>
+BDBucketOpenClosed<state, dataStructure, indexTable>::BDBucketOpenClosed()
+{
+	Reset();
+}
+
+/**
+ * Remove all objects from queue.
+ */
+template<typename state, class dataStructure, class indexTable>
+void BDBucketOpenClosed<state, dataStructure, indexTable>::Reset()
+{
+	table.Clear();
+	compactedClosed.Clear();
+	elements.clear();
+	buckets.clear();
+	for (int x = 0; x < 2; x++)
+	{
+		// keep the allocated rows; only empty them
+		for (auto &r : rows[x])
+		{
+			if (r.count == 0)
+				continue;
+			for (auto &c : r.cols)
+				c.resize(0);
+			r.count = 0;
+		}
+		openCount[x] = 0;
+		minRow[x] = minCol[x] = 0;
+	}
+}
+
+/**
+ * Ready buckets are rows of g, columns of f. Waiting buckets are rows of f,
+ * columns of g; the column order is reversed when searching so that high g
+ * comes first.
+ */
+template<typename state, class dataStructure, class indexTable>
+std::vector<uint64_t> &BDBucketOpenClosed<state, dataStructure, indexTable>::Bucket(stateLocation whichQueue, int g, int f)
+{
+	int row = (whichQueue == kOpenReady)?g:f;
+	int col = (whichQueue == kOpenReady)?f:g;
+	if (row >= (int)rows[whichQueue].size())
+		rows[whichQueue].resize(row+1);
+	if (col >= (int)rows[whichQueue][row].cols.size())
+		rows[whichQueue][row].cols.resize(col+1);
+	return rows[whichQueue][row].cols[col];
+}
+
+template<typename state, class dataStructure, class indexTable>
+void BDBucketOpenClosed<state, dataStructure, indexTable>::Add(uint64_t objKey, stateLocation whichQueue)
+{
+	int g = ToBucket(elements[objKey].g);
+	int f = ToBucket(elements[objKey].g+elements[objKey].h);
+	std::vector<uint64_t> &b = Bucket(whichQueue, g, f);
+	elements[objKey].where = whichQueue;
+	elements[objKey].openLocation = b.size();
+	buckets[objKey].g = g;
+	buckets[objKey].f = f;
+	b.push_back(objKey);
+	openCount[whichQueue]++;
+
+	int row = (whichQueue == kOpenReady)?g:f;
+	int col = (whichQueue == kOpenReady)?f:g;
+	rows[whichQueue][row].count++;
+	// columns of the waiting queue are searched from high to low
+	if (row < minRow[whichQueue] ||
+		(row == minRow[whichQueue] && ((whichQueue == kOpenReady)?(col < minCol[whichQueue]):(col > minCol[whichQueue]))))
+	{
+		minRow[whichQueue] = row;
+		minCol[whichQueue] = col;
+	}
+}
+
+/**
+ * Remove a node from its bucket without changing where it is recorded to be.
+ */
+template<typename state, class dataStructure, class indexTable>
+void BDBucketOpenClosed<state, dataStructure, indexTable>::Unlink(uint64_t objKey)
+{
+	stateLocation whichQueue = elements[objKey].where;
+	assert(whichQueue == kOpenReady || whichQueue == kOpenWaiting);
+	std::vector<uint64_t> &b = Bucket(whichQueue, buckets[objKey].g, buckets[objKey].f);
+	uint64_t index = elements[objKey].openLocation;
+	b[index] = b.back();
+	elements[b[index]].openLocation = index;
+	b.pop_back();
+	openCount[whichQueue]--;
+	rows[whichQueue][(whichQueue == kOpenReady)?buckets[objKey].g:buckets[objKey].f].count--;
+}
+
+/**
+ * Advance minRow/minCol to the first non-empty bucket. Amortized O(1) for
+ * integer costs since the bounds only move past empty buckets.
+ */
+template<typename state, class dataStructure, class indexTable>
+void BDBucketOpenClosed<state, dataStructure, indexTable>::FindMin(stateLocation whichQueue) const
+{
+	assert(openCount[whichQueue] != 0);
+	const std::vector<bucketRow> &r = rows[whichQueue];
+	int row = minRow[whichQueue];
+	while (r[row].count == 0)
+	{
+		row++;
+		minCol[whichQueue] = (whichQueue == kOpenReady)?0:(int)r[row].cols.size()-1;
+	}
+	minRow[whichQueue] = row;
+	const std::vector<std::vector<uint64_t>> &cols = r[row].cols;
+	if (whichQueue == kOpenReady)
+	{
+		int col = minCol[whichQueue];
+		while (cols[col].size() == 0)
+			col++;
+		minCol[whichQueue] = col;
+	}
+	else {
+		int col = std::min(minCol[whichQueue], (int)cols.size()-1);
+		while (cols[col].size() == 0)
+			col--;
+		minCol[whichQueue] = col;
+	}
+}
+
+/**
+ * Add object into open list.
+ */
+template<typename state, class dataStructure, class indexTable>
+uint64_t BDBucketOpenClosed<state, dataStructure, indexTable>::AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent, stateLocation whichQueue)
+{
+	uint64_t existing;
+	if (table.Find(hash, existing))
+	{
+		assert(false);
+	}
+	elements.push_back(dataStructure(val, g, h, parent, 0, whichQueue));
+	buckets.push_back({0, 0});
+	if (parent == kTBDNoNode)
+		elements.back().parentID = elements.size()-1;
+	table.Insert(hash, elements.size()-1); // hashing to element list location
+	Add(elements.size()-1, whichQueue);
+	return elements.size()-1;
+}
+
+/**
+ * Add object into closed list.
+ */
+template<typename state, class dataStructure, class indexTable>
+uint64_t BDBucketOpenClosed<state, dataStructure, indexTable>::AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent)
+{
+	uint64_t existing;
+	assert(!table.Find(hash, existing));
+	elements.push_back(dataStructure(val, g, h, parent, 0, kClosed));
+	buckets.push_back({0, 0});
+	if (parent == kTBDNoNode)
+		elements.back().parentID = elements.size()-1;
+	table.Insert(hash, elements.size()-1); // hashing to element list location
+	return elements.size()-1;
+}
+
+/**
+ * Indicate that the key for a particular object has changed.
+ */
+template<typename state, class dataStructure, class indexTable>
+void BDBucketOpenClosed<state, dataStructure, indexTable>::KeyChanged(uint64_t val)
+{
+	stateLocation whichQueue = elements[val].where;
+	if (whichQueue != kOpenReady && whichQueue != kOpenWaiting)
+		return;
+	Unlink(val);
+	Add(val, whichQueue);
+}
+
+template<typename state, class dataStructure, class indexTable>
+void BDBucketOpenClosed<state, dataStructure, indexTable>::Remove(uint64_t val)
+{
+	Unlink(val);
+	elements[val].where = kClosed;
+}
+
+/**
+ * Returns location of object as well as object key.
+ */
+template<typename state, class dataStructure, class indexTable>
+stateLocation BDBucketOpenClosed<state, dataStructure, indexTable>::Lookup(uint64_t hashKey, uint64_t &objKey) const
+{
+	if (table.Find(hashKey, objKey))
+		return elements[objKey].where;
+	if (compactedClosed.Contains(hashKey))
+	{
+		objKey = kTBDNoNode;
+		return kClosed;
+	}
+	return kUnseen;
+}
+
+template<typename state, class dataStructure, class indexTable>
+bool BDBucketOpenClosed<state, dataStructure, indexTable>::LookupG(uint64_t hashKey, double &g) const
+{
+	uint64_t objKey;
+	if (table.Find(hashKey, objKey))
+	{
+		g = elements[objKey].g;
+		return true;
+	}
+	return compactedClosed.Find(hashKey, g);
+}
+
+/**
+ * Drop the records of all closed nodes, keeping only their hashes and
+ * g-costs; see BDOpenClosed::CompactClosed().
+ */
+template<typename state, class dataStructure, class indexTable>
+size_t BDBucketOpenClosed<state, dataStructure, indexTable>::CompactClosed()
+{
+	std::vector<uint64_t> newID(elements.size(), kTBDNoNode);
+	size_t next = 0;
+	for (size_t x = 0; x < elements.size(); x++)
+		if (elements[x].where != kClosed)
+			newID[x] = next++;
+	size_t dropped = elements.size()-next;
+	if (dropped == 0)
+		return 0;
+
+	std::vector<std::pair<uint64_t, uint64_t>> kept;
+	kept.reserve(next);
+	table.ForEach([&](uint64_t hash, uint64_t id) {
+		if (newID[id] != kTBDNoNode)
+			kept.push_back(std::make_pair(hash, newID[id]));
+		else
+			compactedClosed.Insert(hash, elements[id].g);
+	});
+	table.Clear();
+	for (const auto &i : kept)
+		table.Insert(i.first, i.second);
+
+	for (size_t x = 0; x < elements.size(); x++)
+	{
+		if (newID[x] == kTBDNoNode)
+			continue;
+		elements[newID[x]] = elements[x];
+		buckets[newID[x]] = buckets[x];
+	}
+	elements.resize(next);
+	buckets.resize(next);
+	BDShrinkCapacity(elements);
+	BDShrinkCapacity(buckets);
+	for (auto &e : elements)
+		if (e.parentID != kTBDNoNode)
+			e.parentID = newID[e.parentID];
+	for (int x = 0; x < 2; x++)
+		for (auto &r : rows[x])
+			for (auto &c : r.cols)
+				for (uint64_t &id : c)
+					id = newID[id];
+	return dropped;
+}
+
+/**
+ * Peek at the next item to be expanded.
+ */
+template<typename state, class dataStructure, class indexTable>
+uint64_t BDBucketOpenClosed<state, dataStructure, indexTable>::Peek(stateLocation whichQueue) const
+{
+	FindMin(whichQueue);
+	return rows[whichQueue][minRow[whichQueue]].cols[minCol[whichQueue]].back();
+}
+
+/**
+ * Move the best item to the closed list and return key.
+ */
+template<typename state, class dataStructure, class indexTable>
+uint64_t BDBucketOpenClosed<state, dataStructure, indexTable>::Close()
+{
+	assert(OpenReadySize() != 0);
+	uint64_t ans = Peek(kOpenReady);
+	Unlink(ans);
+	elements[ans].where = kClosed;
+	return ans;
+}
+
+template<typename state, class dataStructure, class indexTable>
+uint64_t BDBucketOpenClosed<state, dataStructure, indexTable>::PutToReady()
+{
+	assert(OpenWaitingSize() != 0);
+	uint64_t ans = Peek(kOpenWaiting);
+	Unlink(ans);
+	Add(ans, kOpenReady);
+	return ans;
+}
+
+#endif
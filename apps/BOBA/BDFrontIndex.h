@@ -0,0 +1,97 @@
+/*
+ *  BDFrontIndex.h
+ *
+ *  Index of the open nodes of one BOBA queue, binned by floor(g) and floor(h).
+ *  Used for front-to-front bounds, which only need the open nodes of the
+ *  opposite direction that can still be on a solution below a threshold.
+ */
+
+#ifndef BDFRONTINDEX_H
+#define BDFRONTINDEX_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+#include "BDOpenClosed.h"
+
+/**
+ * h is the node's heuristic towards the target of its own direction. With a
+ * consistent heuristic, h(s, s') >= |h(s, t)-h(s', t)| for that target t, so
+ * whole bins can be skipped for a state s without evaluating h(s, s').
+ *
+ * Entries are never removed individually. Nodes that are closed, removed or
+ * moved to another bin by a lower g-cost are skipped when the bins are
+ * scanned, and Rebuild() drops them once they outnumber the open nodes.
+ * Ids are those of the queue, so the index must be rebuilt after the queue
+ * compacts its records.
+ */
+class BDFrontIndex {
+public:
+	BDFrontIndex() :entries(0) {}
+	void Clear()
+	{
+		for (auto &row : bins)
+			for (auto &b : row)
+				b.resize(0);
+		entries = 0;
+	}
+	size_t Entries() const { return entries; }
+	void Add(uint64_t id, double g, double h)
+	{
+		size_t gBin = Bin(g), hBin = Bin(h);
+		if (gBin >= bins.size())
+			bins.resize(gBin+1);
+		if (hBin >= bins[gBin].size())
+			bins[gBin].resize(hBin+1);
+		bins[gBin][hBin].push_back(id);
+		entries++;
+	}
+	/** Re-index only the open nodes of the queue. */
+	template <class queue>
+	void Rebuild(const queue &q)
+	{
+		Clear();
+		for (uint64_t x = 0; x < q.size(); x++)
+		{
+			const auto &i = q.Lookat(x);
+			if (i.where == kOpenReady || i.where == kOpenWaiting)
+				Add(x, i.g, i.h);
+		}
+	}
+	/**
+	 * Call f(id) for the open nodes s' with g(s')+|h-h(s')| below bound, where
+	 * h is the heuristic of s towards the index's target, lowest g first,
+	 * until f returns true. Returns whether it did. Does not modify the index,
+	 * so it can be called from several threads.
+	 */
+	template <class queue, class F>
+	bool Any(const queue &q, double bound, double h, F f) const
+	{
+		for (size_t gBin = 0; gBin < bins.size() && gBin < bound; gBin++)
+		{
+			for (size_t hBin = 0; hBin < bins[gBin].size(); hBin++)
+			{
+				// smallest |h-h(s')| for h(s') in [hBin, hBin+1)
+				double hGap = std::max(0.0, std::max(hBin-h, h-(hBin+1)));
+				if (gBin+hGap >= bound)
+					continue;
+				for (uint64_t id : bins[gBin][hBin])
+				{
+					const auto &i = q.Lookat(id);
+					if ((i.where != kOpenReady && i.where != kOpenWaiting) || Bin(i.g) != gBin)
+						continue;
+					if (f(id))
+						return true;
+				}
+			}
+		}
+		return false;
+	}
+private:
+	static inline size_t Bin(double g) { return (size_t)std::floor(g); }
+	std::vector<std::vector<std::vector<uint64_t>>> bins; // [g][h]
+	size_t entries;
+};
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ *  BDIndexTable.h
+ *
+ *  Index tables mapping state hashes to element ids for BDOpenClosed.
+ *  BDHashMapIndex wraps the original node-based __gnu_cxx::hash_map;
+ *  BDLinearProbeIndex is a flat open-addressing table that keeps keys
+ *  and ids in one contiguous array. EpochIndexTable (algorithms/) has the
+ *  same interface, clears in O(1) and is the default.
+ */
+
+#ifndef BDINDEXTABLE_H
+#define BDINDEXTABLE_H
+
+#include <cassert>
+#include <vector>
+#include <ext/hash_map>
+#include <stdint.h>
+#include "EpochIndexTable.h"
+
+struct BDHash64 {
+	size_t operator()(const uint64_t &x) const
+	{ return (size_t)(x); }
+};
+
+/**
+ * The original index table. Lookups do not affect the search order, so it
+ * gives the same results as the other tables.
+ */
+class BDHashMapIndex {
+public:
+	void Clear() { table.clear(); }
+	void Reserve(size_t count) { table.resize(count); }
+	size_t Size() const { return table.size(); }
+	size_t MemoryUsage() const
+	{ return table.bucket_count()*sizeof(void*)+table.size()*(sizeof(std::pair<uint64_t, uint64_t>)+sizeof(void*)); }
+
+	bool Find(uint64_t key, uint64_t &value) const
+	{
+		IndexTable::const_iterator it = table.find(key);
+		if (it == table.end())
+			return false;
+		value = (*it).second;
+		return true;
+	}
+	void Insert(uint64_t key, uint64_t value) { table[key] = value; }
+	/** Call f(key, value) for every entry. */
+	template <typename F>
+	void ForEach(F f) const
+	{
+		for (const auto &i : table)
+			f(i.first, i.second);
+	}
+private:
+	typedef __gnu_cxx::hash_map<uint64_t, uint64_t, BDHash64> IndexTable;
+	IndexTable table;
+};
+
+/**
+ * Linear-probe open-addressing table. Capacity is always a power of two.
+ * Element ids are never kEmpty (all ones), so that value marks free slots
+ * and any 64-bit key can be stored. Entries are never removed individually.
+ */
+class BDLinearProbeIndex {
+public:
+	BDLinearProbeIndex(size_t initialCapacity = 1024, double maxLoad = 0.5)
+	:count(0), maxLoad(maxLoad)
+	{ assert(maxLoad > 0 && maxLoad < 1); Rehash(initialCapacity); }
+
+	/** Remove all entries, keeping the current capacity. */
+	void Clear()
+	{
+		if (count == 0)
+			return;
+		for (auto &s : slots)
+			s.value = kEmpty;
+		count = 0;
+	}
+	/** Make sure count entries can be inserted without rehashing. */
+	void Reserve(size_t numEntries)
+	{
+		size_t needed = (size_t)(numEntries/maxLoad)+1;
+		if (needed > slots.size())
+			Rehash(needed);
+	}
+	/** Resize the table to at least minCapacity slots and reinsert all entries. */
+	void Rehash(size_t minCapacity)
+	{
+		size_t newCapacity = 16;
+		while (newCapacity < minCapacity || newCapacity*maxLoad < count)
+			newCapacity <<= 1;
+		std::vector<slot> old;
+		old.swap(slots);
+		slots.resize(newCapacity);
+		mask = newCapacity-1;
+		growAt = (size_t)(newCapacity*maxLoad);
+		count = 0;
+		for (const auto &s : old)
+			if (s.value != kEmpty)
+				Place(s.key, s.value);
+	}
+	void SetMaxLoadFactor(double load)
+	{ assert(load > 0 && load < 1); maxLoad = load; Rehash(slots.size()); }
+	size_t Size() const { return count; }
+	size_t Capacity() const { return slots.size(); }
+	size_t MemoryUsage() const { return slots.size()*sizeof(slot); }
+
+	bool Find(uint64_t key, uint64_t &value) const
+	{
+		for (size_t i = MixHashBits(key)&mask; ; i = (i+1)&mask)
+		{
+			const slot &s = slots[i];
+			if (s.value == kEmpty)
+				return false;
+			if (s.key == key)
+			{
+				value = s.value;
+				return true;
+			}
+		}
+	}
+	void Insert(uint64_t key, uint64_t value)
+	{
+		assert(value != kEmpty);
+		if (count >= growAt)
+			Rehash(slots.size()*2);
+		Place(key, value);
+	}
+	/** Call f(key, value) for every entry. */
+	template <typename F>
+	void ForEach(F f) const
+	{
+		for (const auto &s : slots)
+			if (s.value != kEmpty)
+				f(s.key, s.value);
+	}
+private:
+	static const uint64_t kEmpty = 0xFFFFFFFFFFFFFFFFull;
+	struct slot {
+		slot() :key(0), value(kEmpty) {}
+		uint64_t key;
+		uint64_t value;
+	};
+	void Place(uint64_t key, uint64_t value)
+	{
+		for (size_t i = MixHashBits(key)&mask; ; i = (i+1)&mask)
+		{
+			slot &s = slots[i];
+			if (s.value == kEmpty)
+			{
+				s.key = key;
+				s.value = value;
+				count++;
+				return;
+			}
+			if (s.key == key)
+			{
+				s.value = value;
+				return;
+			}
+		}
+	}
+	std::vector<slot> slots;
+	size_t mask;
+	size_t count;
+	size_t growAt;
+	double maxLoad;
+};
+
+/**
+ * Linear-probe map from 64-bit state hashes to g-costs, used to remember
+ * closed states whose full records have been dropped. Duplicate detection
+ * needs only the key and path reconstruction needs only the g-cost, so each
+ * entry is 16 bytes no matter how large the state is. kEmpty itself is kept
+ * in a separate slot so that any key can be stored.
+ */
+class BDCompactClosedSet {
+public:
+	BDCompactClosedSet() :count(0), hasEmptyKey(false), emptyKeyG(0) { Rehash(16); }
+	void Clear()
+	{
+		if (Size() == 0)
+			return;
+		for (auto &s : slots)
+			s.key = kEmpty;
+		count = 0;
+		hasEmptyKey = false;
+	}
+	size_t Size() const { return count+(hasEmptyKey?1:0); }
+	size_t MemoryUsage() const { return slots.size()*sizeof(slot); }
+	bool Contains(uint64_t key) const
+	{
+		double g;
+		return Find(key, g);
+	}
+	bool Find(uint64_t key, double &g) const
+	{
+		if (key == kEmpty)
+		{
+			g = emptyKeyG;
+			return hasEmptyKey;
+		}
+		for (size_t i = MixHashBits(key)&mask; ; i = (i+1)&mask)
+		{
+			if (slots[i].key == key)
+			{
+				g = slots[i].g;
+				return true;
+			}
+			if (slots[i].key == kEmpty)
+				return false;
+		}
+	}
+	void Insert(uint64_t key, double g)
+	{
+		if (key == kEmpty)
+		{
+			hasEmptyKey = true;
+			emptyKeyG = g;
+			return;
+		}
+		if (count*2 >= slots.size())
+			Rehash(slots.size()*2);
+		Place(key, g);
+	}
+private:
+	static const uint64_t kEmpty = 0xFFFFFFFFFFFFFFFFull;
+	struct slot {
+		uint64_t key;
+		double g;
+	};
+	void Rehash(size_t newCapacity)
+	{
+		std::vector<slot> old;
+		old.swap(slots);
+		slots.resize(newCapacity);
+		for (auto &s : slots)
+			s.key = kEmpty;
+		mask = newCapacity-1;
+		count = 0;
+		for (const auto &s : old)
+			if (s.key != kEmpty)
+				Place(s.key, s.g);
+	}
+	void Place(uint64_t key, double g)
+	{
+		for (size_t i = MixHashBits(key)&mask; ; i = (i+1)&mask)
+		{
+			if (slots[i].key == key)
+			{
+				slots[i].g = g;
+				return;
+			}
+			if (slots[i].key == kEmpty)
+			{
+				slots[i].key = key;
+				slots[i].g = g;
+				count++;
+				return;
+			}
+		}
+	}
+	std::vector<slot> slots;
+	size_t mask;
+	size_t count;
+	bool hasEmptyKey;
+	double emptyKeyG;
+};
+
+#endif
@@ -7,8 +7,8 @@
 
 #include <cassert>
 #include <vector>
-#include <ext/hash_map>
 #include <stdint.h>
+#include "BDIndexTable.h"
 
 /*
 struct AHash64 {
@@ -43,12 +43,65 @@ public:
 	stateLocation where;
 };
 
-template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure = BDOpenClosedData<state> >
+/**
+ * Stands in for parentID in records that do not store a parent pointer.
+ * Assignments are ignored and it always reads as kTBDNoNode.
+ */
+struct BDNoParentID {
+	BDNoParentID &operator=(uint64_t) { return *this; }
+	operator uint64_t() const { return kTBDNoNode; }
+};
+
+/**
+ * BDOpenClosedData without the parent pointer, 8 bytes smaller per node.
+ * BOBA rebuilds the solution path from the stored g-costs instead.
+ */
+template<typename state>
+class BDOpenClosedDataNoParent {
+public:
+	BDOpenClosedDataNoParent() {}
+	BDOpenClosedDataNoParent(const state &theData, double gCost, double hCost, uint64_t, uint64_t openLoc, stateLocation location,double pathC =0)
+	:data(theData), g(gCost), h(hCost), pathCost(pathC), openLocation(openLoc), where(location) { reopened = false; }
+	// BOBA keeps copies of queue heads as BDOpenClosedData
+	operator BDOpenClosedData<state>() const
+	{
+		BDOpenClosedData<state> result(data, g, h, kTBDNoNode, openLocation, where, pathCost);
+		result.reopened = reopened;
+		return result;
+	}
+	state data;
+	double g;
+	double h;
+	double pathCost;
+	uint64_t openLocation;
+	bool reopened;
+	BDNoParentID parentID;
+	stateLocation where;
+};
+
+/**
+ * Release the unused capacity of v after records were dropped, leaving room
+ * to grow by half so that the next insertion does not double it right away.
+ */
+template <typename T>
+void BDShrinkCapacity(std::vector<T> &v)
+{
+	if (v.capacity() <= v.size()+v.size()/2)
+		return;
+	std::vector<T> tmp;
+	tmp.reserve(v.size()+v.size()/2);
+	tmp.insert(tmp.end(), v.begin(), v.end());
+	v.swap(tmp);
+}
+
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure = BDOpenClosedData<state>, class indexTable = EpochIndexTable >
 class BDOpenClosed {
 public:
 	BDOpenClosed();
 	~BDOpenClosed();
 	void Reset();
+	// pre-size the element storage and index table for an expected number of states
+	void Reserve(size_t count) { elements.reserve(count); table.Reserve(count); }
 	uint64_t AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent=kTBDNoNode, stateLocation whichQueue = kOpenWaiting);
 	uint64_t AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent=kTBDNoNode);
 	void KeyChanged(uint64_t objKey);
@@ -64,6 +117,8 @@ public:
 	//bool ExtractMinPair(uint64_t& left, uint64_t& right) ;
 	uint64_t Close();
 	uint64_t PutToReady();
+	uint64_t PutToReadyDeferred();
+	void RestoreReadyQueue();
 	//void Reopen(uint64_t objKey);
 
 	uint64_t GetOpenItem(unsigned int which, stateLocation where){	return priorityQueues[where][which];}
@@ -73,6 +128,17 @@ public:
 
 	size_t ClosedSize() const { return size()-OpenReadySize()-OpenWaitingSize(); }
 	size_t size() const { return elements.size(); }
+	// g-cost of a state that has a record or was dropped by CompactClosed
+	bool LookupG(uint64_t hashKey, double &g) const;
+	size_t CompactClosed();
+	// closed states whose records were dropped by CompactClosed
+	size_t CompactedSize() const { return compactedClosed.Size(); }
+	size_t MemoryUsage() const
+	{
+		return elements.capacity()*sizeof(dataStructure)+
+		(priorityQueues[0].capacity()+priorityQueues[1].capacity())*sizeof(uint64_t)+
+		table.MemoryUsage()+compactedClosed.MemoryUsage();
+	}
 	void verifyData();
 	bool ValidateOpenReady(int index = 0)
 	{
@@ -118,40 +184,45 @@ private:
 	//std::vector<uint64_t> waitingQueue;
 
 	// storing the element id; looking up with...hash?
-	typedef __gnu_cxx::hash_map<uint64_t, uint64_t, AHash64> IndexTable;
-	
-	IndexTable table;
+	indexTable table;
+	// hashes and g-costs of closed states that no longer have a record
+	BDCompactClosedSet compactedClosed;
+	// number of entries at the end of the ready queue not yet in heap order
+	size_t deferredReady;
 	//all the elements, open or closed
 	std::vector<dataStructure> elements;
 };
 
 
-template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure>
-BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure>::BDOpenClosed()
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::BDOpenClosed()
 {
 	std::vector<uint64_t> queue;
 	queue.resize(0);
 	priorityQueues.push_back(queue);
 	priorityQueues.push_back(queue);
+	deferredReady = 0;
 	//readyQueue.resize(0);
 	//waitingQueue.resize(0);
 }
 
-template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure>
-BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure>::~BDOpenClosed()
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::~BDOpenClosed()
 {
 }
 
 /**
  * Remove all objects from queue.
  */
-template<typename state, typename CmpKey0, typename CmpKey1,   class dataStructure>
-void BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::Reset()
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+void BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::Reset()
 {
-	table.clear();
+	table.Clear();
+	compactedClosed.Clear();
 	elements.clear();
 	priorityQueues[0].resize(0);
 	priorityQueues[1].resize(0);
+	deferredReady = 0;
 	//readyQueue.resize(0);
 	//waitingQueue.resize(0);
 }
@@ -159,11 +230,12 @@ void BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::Reset()
 /**
  * Add object into open list.
  */
-template<typename state, typename CmpKey0, typename CmpKey1,   class dataStructure>
-uint64_t BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent, stateLocation whichQueue)
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+uint64_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent, stateLocation whichQueue)
 {
 	// should do lookup here...
-	if (table.find(hash) != table.end())
+	uint64_t existing;
+	if (table.Find(hash, existing))
 	{
 		//return -1; // TODO: find correct id and return
 		assert(false);
@@ -180,7 +252,7 @@ uint64_t BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::AddOpenNode(con
 
 	if (parent == kTBDNoNode)
 		elements.back().parentID = elements.size()-1;
-	table[hash] = elements.size()-1; // hashing to element list location
+	table.Insert(hash, elements.size()-1); // hashing to element list location
 
 	priorityQueues[whichQueue].push_back(elements.size() - 1);
 	HeapifyUp(priorityQueues[whichQueue].size() - 1,whichQueue);
@@ -191,23 +263,24 @@ uint64_t BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::AddOpenNode(con
 /**
  * Add object into closed list.
  */
-template<typename state, typename CmpKey0, typename CmpKey1,   class dataStructure>
-uint64_t BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent)
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+uint64_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent)
 {
 	// should do lookup here...
-	assert(table.find(hash) == table.end());
+	uint64_t existing;
+	assert(!table.Find(hash, existing));
 	elements.push_back(dataStructure(val, g, h, parent, 0, kClosed));
 	if (parent == kTBDNoNode)
 		elements.back().parentID = elements.size()-1;
-	table[hash] = elements.size()-1; // hashing to element list location
+	table.Insert(hash, elements.size()-1); // hashing to element list location
 	return elements.size()-1;
 }
 
 /**
  * Indicate that the key for a particular object has changed.
  */
-template<typename state, typename CmpKey0, typename CmpKey1,   class dataStructure>
-void BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::KeyChanged(uint64_t val)
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+void BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::KeyChanged(uint64_t val)
 {
 //	EqKey eq;
 //	assert(eq(waitingQueue[table[val]], val));
@@ -225,8 +298,8 @@ void BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::KeyChanged(uint64_t
 	}
 }
 
-template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure>
-void BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure>::Remove(uint64_t val)
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+void BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::Remove(uint64_t val)
 {
 
 	int index = elements[val].openLocation;
@@ -245,8 +318,8 @@ void BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure>::Remove(uint64_t val)
 ///**
 // * Indicate that the key for a particular object has increased.
 // */
-//template<typename state, typename CmpKey0, typename CmpKey1,   class dataStructure>
-//void BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::IncreaseKey(uint64_t val)
+//template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+//void BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::IncreaseKey(uint64_t val)
 //{
 ////	EqKey eq;
 ////	assert(eq(waitingQueue[table[val]], val));
@@ -258,25 +331,82 @@ void BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure>::Remove(uint64_t val)
  * Returns location of object as well as object key.
  */
 
-template<typename state, typename CmpKey0, typename CmpKey1,   class dataStructure>
-stateLocation BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::Lookup(uint64_t hashKey, uint64_t &objKey) const
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+stateLocation BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::Lookup(uint64_t hashKey, uint64_t &objKey) const
 {
-	typename IndexTable::const_iterator it;
-	it = table.find(hashKey);
-	if (it != table.end())
-	{
-		objKey = (*it).second;
+	if (table.Find(hashKey, objKey))
 		return elements[objKey].where;
+	if (compactedClosed.Contains(hashKey))
+	{
+		objKey = kTBDNoNode;
+		return kClosed;
 	}
 	return kUnseen;
 }
 
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+bool BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::LookupG(uint64_t hashKey, double &g) const
+{
+	uint64_t objKey;
+	if (table.Find(hashKey, objKey))
+	{
+		g = elements[objKey].g;
+		return true;
+	}
+	return compactedClosed.Find(hashKey, g);
+}
+
+/**
+ * Drop the records of all closed nodes, keeping only their hashes and
+ * g-costs. Lookup() still reports them as closed (with objKey kTBDNoNode)
+ * and LookupG() still finds their g-cost. Element ids are renumbered and
+ * open nodes whose parent was dropped lose their parent pointer.
+ * Returns the number of records dropped.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+size_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::CompactClosed()
+{
+	std::vector<uint64_t> newID(elements.size(), kTBDNoNode);
+	size_t next = 0;
+	for (size_t x = 0; x < elements.size(); x++)
+		if (elements[x].where != kClosed)
+			newID[x] = next++;
+	size_t dropped = elements.size()-next;
+	if (dropped == 0)
+		return 0;
+
+	std::vector<std::pair<uint64_t, uint64_t>> kept;
+	kept.reserve(next);
+	table.ForEach([&](uint64_t hash, uint64_t id) {
+		if (newID[id] != kTBDNoNode)
+			kept.push_back(std::make_pair(hash, newID[id]));
+		else
+			compactedClosed.Insert(hash, elements[id].g);
+	});
+	table.Clear();
+	for (const auto &i : kept)
+		table.Insert(i.first, i.second);
+
+	for (size_t x = 0; x < elements.size(); x++)
+		if (newID[x] != kTBDNoNode)
+			elements[newID[x]] = elements[x];
+	elements.resize(next);
+	BDShrinkCapacity(elements);
+	for (auto &e : elements)
+		if (e.parentID != kTBDNoNode)
+			e.parentID = newID[e.parentID];
+	for (int q = 0; q < 2; q++)
+		for (uint64_t &id : priorityQueues[q])
+			id = newID[id];
+	return dropped;
+}
+
 
 /**
  * Peek at the next item to be expanded.
  */
-template<typename state, typename CmpKey0, typename CmpKey1,   class dataStructure>
-uint64_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure>::Peek(stateLocation whichQueue) const
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+uint64_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::Peek(stateLocation whichQueue) const
 {
 	if (whichQueue == kOpenReady)
 	{
@@ -294,8 +424,8 @@ uint64_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure>::Peek(stateLocatio
 /**
  * Move the best item to the closed list and return key.
  */
-template<typename state, typename CmpKey0, typename CmpKey1,   class dataStructure>
-uint64_t BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::Close()
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+uint64_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::Close()
 {
 	assert(OpenReadySize() != 0);
 
@@ -310,8 +440,8 @@ uint64_t BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::Close()
 	return ans;
 }
 
-template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure>
-uint64_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure>::PutToReady()
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+uint64_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::PutToReady()
 {
 	assert(OpenWaitingSize() != 0);
 
@@ -340,11 +470,57 @@ uint64_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure>::PutToReady()
 	return ans;
 }
 
+/**
+ * Move the best waiting node to the end of the ready queue without restoring
+ * the ready heap, so that a batch of nodes can be migrated for the cost of a
+ * single heap rebuild. RestoreReadyQueue() must be called before the ready
+ * queue is used again.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+uint64_t BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::PutToReadyDeferred()
+{
+	assert(OpenWaitingSize() != 0);
+	std::vector<uint64_t> &waiting = priorityQueues[kOpenWaiting];
+
+	uint64_t ans = waiting[0];
+	waiting[0] = waiting.back();
+	elements[waiting[0]].openLocation = 0;
+	waiting.pop_back();
+	HeapifyDown(0, kOpenWaiting);
+
+	priorityQueues[kOpenReady].push_back(ans);
+	elements[ans].where = kOpenReady;
+	elements[ans].openLocation = priorityQueues[kOpenReady].size()-1;
+	deferredReady++;
+	return ans;
+}
+
+/**
+ * Restore the ready heap after PutToReadyDeferred(). Large batches rebuild the
+ * heap bottom-up in O(n); small ones are sifted up one at a time.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+void BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::RestoreReadyQueue()
+{
+	std::vector<uint64_t> &ready = priorityQueues[kOpenReady];
+	size_t heapSize = ready.size()-deferredReady;
+	if (deferredReady > heapSize)
+	{
+		for (size_t x = ready.size()/2; x > 0; x--)
+			HeapifyDown(x-1, kOpenReady);
+	}
+	else {
+		for (size_t x = heapSize; x < ready.size(); x++)
+			HeapifyUp(x, kOpenReady);
+	}
+	deferredReady = 0;
+}
+
 /**
  * Moves a node up the heap. Returns true if the node was moved, false otherwise.
  */
-template<typename state, typename CmpKey0, typename CmpKey1,   class dataStructure>
-bool BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::HeapifyUp(unsigned int index, stateLocation whichQueue)
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+bool BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::HeapifyUp(unsigned int index, stateLocation whichQueue)
 {
 	if (index == 0) return false;
 	int parent = (index-1)/2;
@@ -382,8 +558,8 @@ bool BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::HeapifyUp(unsigned
 	return false;
 }
 
-template<typename state, typename CmpKey0, typename CmpKey1,   class dataStructure>
-void BDOpenClosed<state, CmpKey0, CmpKey1,   dataStructure>::HeapifyDown(unsigned int index, stateLocation whichQueue)
+template<typename state, typename CmpKey0, typename CmpKey1, class dataStructure, class indexTable>
+void BDOpenClosed<state, CmpKey0, CmpKey1, dataStructure, indexTable>::HeapifyDown(unsigned int index, stateLocation whichQueue)
 {
 	
 	unsigned int child1 = index*2+1;
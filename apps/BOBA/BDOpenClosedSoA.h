@@ -0,0 +1,493 @@
+/*
+ *  BDOpenClosedSoA.h
+ *
+ *  Drop-in replacement for BDOpenClosed that stores nodes as a structure of
+ *  arrays. The fields the heaps touch on every comparison (g, h, queue
+ *  location) live in one dense array; the state, parent and path cost are
+ *  kept in separate arrays and only read when a node is expanded or a path
+ *  is extracted.
+ *
+ *  Lookup()/Lookat() return small proxy objects whose members are references
+ *  into those arrays, so code written against BDOpenClosedData
+ *  (x.g, x.data, x.parentID = ...) works unchanged.
+ */
+
+#ifndef BDOPENCLOSEDSOA_H
+#define BDOPENCLOSEDSOA_H
+
+#include <cassert>
+#include <vector>
+#include <stdint.h>
+#include "BDOpenClosed.h"
+
+struct BDOpenClosedHotData {
+	BDOpenClosedHotData() {}
+	BDOpenClosedHotData(double gCost, double hCost, uint64_t openLoc, stateLocation location)
+	:g(gCost), h(hCost), openLocation(openLoc), where(location), reopened(false) {}
+	double g;
+	double h;
+	uint64_t openLocation;
+	stateLocation where;
+	bool reopened;
+};
+
+template<typename state>
+class BDOpenClosedRef {
+public:
+	BDOpenClosedRef(state &d, BDOpenClosedHotData &hot, uint64_t &parent, double &pathC)
+	:data(d), g(hot.g), h(hot.h), pathCost(pathC), parentID(parent), openLocation(hot.openLocation), reopened(hot.reopened), where(hot.where) {}
+	operator BDOpenClosedData<state>() const
+	{
+		BDOpenClosedData<state> result(data, g, h, parentID, openLocation, where, pathCost);
+		result.reopened = reopened;
+		return result;
+	}
+	state &data;
+	double &g;
+	double &h;
+	double &pathCost;
+	uint64_t &parentID;
+	uint64_t &openLocation;
+	bool &reopened;
+	stateLocation &where;
+};
+
+template<typename state>
+class BDOpenClosedConstRef {
+public:
+	BDOpenClosedConstRef(const state &d, const BDOpenClosedHotData &hot, const uint64_t &parent, const double &pathC)
+	:data(d), g(hot.g), h(hot.h), pathCost(pathC), parentID(parent), openLocation(hot.openLocation), reopened(hot.reopened), where(hot.where) {}
+	operator BDOpenClosedData<state>() const
+	{
+		BDOpenClosedData<state> result(data, g, h, parentID, openLocation, where, pathCost);
+		result.reopened = reopened;
+		return result;
+	}
+	const state &data;
+	const double &g;
+	const double &h;
+	const double &pathCost;
+	const uint64_t &parentID;
+	const uint64_t &openLocation;
+	const bool &reopened;
+	const stateLocation &where;
+};
+
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable = EpochIndexTable>
+class BDOpenClosedSoA {
+public:
+	BDOpenClosedSoA() :deferredReady(0) {}
+	~BDOpenClosedSoA() {}
+	void Reset();
+	void Reserve(size_t count);
+	uint64_t AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent=kTBDNoNode, stateLocation whichQueue = kOpenWaiting);
+	uint64_t AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent=kTBDNoNode);
+	void KeyChanged(uint64_t objKey);
+	void Remove(uint64_t objKey);
+	stateLocation Lookup(uint64_t hashKey, uint64_t &objKey) const;
+	inline BDOpenClosedRef<state> Lookup(uint64_t objKey)
+	{ return BDOpenClosedRef<state>(states[objKey], hot[objKey], parents[objKey], pathCosts[objKey]); }
+	inline BDOpenClosedConstRef<state> Lookat(uint64_t objKey) const
+	{ return BDOpenClosedConstRef<state>(states[objKey], hot[objKey], parents[objKey], pathCosts[objKey]); }
+	uint64_t Peek(stateLocation whichQueue) const;
+	uint64_t Close();
+	uint64_t PutToReady();
+	uint64_t PutToReadyDeferred();
+	void RestoreReadyQueue();
+
+	uint64_t GetOpenItem(unsigned int which, stateLocation where) { return priorityQueues[where][which]; }
+	size_t OpenReadySize() const { return priorityQueues[kOpenReady].size(); }
+	size_t OpenWaitingSize() const { return priorityQueues[kOpenWaiting].size(); }
+	size_t OpenSize() const { return priorityQueues[kOpenReady].size()+priorityQueues[kOpenWaiting].size(); }
+
+	size_t ClosedSize() const { return size()-OpenReadySize()-OpenWaitingSize(); }
+	size_t size() const { return hot.size(); }
+	bool LookupG(uint64_t hashKey, double &g) const;
+	size_t CompactClosed();
+	size_t CompactedSize() const { return compactedClosed.Size(); }
+	size_t MemoryUsage() const
+	{
+		return hot.capacity()*sizeof(BDOpenClosedHotData)+states.capacity()*sizeof(state)+
+		(parents.capacity()+priorityQueues[0].capacity()+priorityQueues[1].capacity())*sizeof(uint64_t)+
+		pathCosts.capacity()*sizeof(double)+table.MemoryUsage()+compactedClosed.MemoryUsage();
+	}
+	bool ValidateOpenReady() const { return Validate<CmpKey0>(kOpenReady); }
+	bool ValidateOpenWaiting() const { return Validate<CmpKey1>(kOpenWaiting); }
+private:
+	uint64_t AddNode(const state &val, uint64_t hash, double g, double h, uint64_t parent, uint64_t openLoc, stateLocation where);
+	bool HeapifyUp(unsigned int index, stateLocation whichQueue)
+	{ return (whichQueue == kOpenReady)?HeapifyUp<CmpKey0>(index, whichQueue):HeapifyUp<CmpKey1>(index, whichQueue); }
+	void HeapifyDown(unsigned int index, stateLocation whichQueue)
+	{ if (whichQueue == kOpenReady) HeapifyDown<CmpKey0>(index, whichQueue); else HeapifyDown<CmpKey1>(index, whichQueue); }
+	template <typename compare>
+	bool HeapifyUp(unsigned int index, stateLocation whichQueue);
+	template <typename compare>
+	void HeapifyDown(unsigned int index, stateLocation whichQueue);
+	template <typename compare>
+	bool Validate(stateLocation whichQueue) const;
+
+	//priorityQueues[0] is openReady, priorityQueues[1] is openWaiting
+	std::vector<uint64_t> priorityQueues[2];
+	indexTable table;
+	// hashes of closed states that no longer have a record
+	BDCompactClosedSet compactedClosed;
+	// number of entries at the end of the ready queue not yet in heap order
+	size_t deferredReady;
+
+	// hot data, read by the heap comparisons
+	std::vector<BDOpenClosedHotData> hot;
+	// cold data, read on expansion and path extraction
+	std::vector<state> states;
+	std::vector<uint64_t> parents;
+	std::vector<double> pathCosts;
+};
+
+/**
+ * Remove all objects from queue.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+void BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::Reset()
+{
+	table.Clear();
+	compactedClosed.Clear();
+	hot.clear();
+	states.clear();
+	parents.clear();
+	pathCosts.clear();
+	priorityQueues[0].resize(0);
+	priorityQueues[1].resize(0);
+	deferredReady = 0;
+}
+
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+void BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::Reserve(size_t count)
+{
+	table.Reserve(count);
+	hot.reserve(count);
+	states.reserve(count);
+	parents.reserve(count);
+	pathCosts.reserve(count);
+}
+
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+uint64_t BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::AddNode(const state &val, uint64_t hash, double g, double h,
+																	 uint64_t parent, uint64_t openLoc, stateLocation where)
+{
+	uint64_t id = hot.size();
+	hot.push_back(BDOpenClosedHotData(g, h, openLoc, where));
+	states.push_back(val);
+	parents.push_back((parent == kTBDNoNode)?id:parent);
+	pathCosts.push_back(0);
+	table.Insert(hash, id); // hashing to element list location
+	return id;
+}
+
+/**
+ * Add object into open list.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+uint64_t BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent, stateLocation whichQueue)
+{
+	uint64_t existing;
+	if (table.Find(hash, existing))
+	{
+		assert(false);
+	}
+	assert(whichQueue == kOpenReady || whichQueue == kOpenWaiting);
+	uint64_t id = AddNode(val, hash, g, h, parent, priorityQueues[whichQueue].size(), whichQueue);
+	priorityQueues[whichQueue].push_back(id);
+	HeapifyUp(priorityQueues[whichQueue].size() - 1, whichQueue);
+	return id;
+}
+
+/**
+ * Add object into closed list.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+uint64_t BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent)
+{
+	uint64_t existing;
+	assert(!table.Find(hash, existing));
+	return AddNode(val, hash, g, h, parent, 0, kClosed);
+}
+
+/**
+ * Indicate that the key for a particular object has changed.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+void BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::KeyChanged(uint64_t val)
+{
+	stateLocation whichQueue = hot[val].where;
+	if (whichQueue == kOpenReady || whichQueue == kOpenWaiting)
+	{
+		if (!HeapifyUp(hot[val].openLocation, whichQueue))
+			HeapifyDown(hot[val].openLocation, whichQueue);
+	}
+}
+
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+void BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::Remove(uint64_t val)
+{
+	uint64_t index = hot[val].openLocation;
+	stateLocation whichQueue = hot[val].where;
+	hot[val].where = kClosed;
+	priorityQueues[whichQueue][index] = priorityQueues[whichQueue].back();
+	hot[priorityQueues[whichQueue][index]].openLocation = index;
+	priorityQueues[whichQueue].pop_back();
+
+	if (index < priorityQueues[whichQueue].size() && !HeapifyUp(index, whichQueue))
+		HeapifyDown(index, whichQueue);
+}
+
+/**
+ * Returns location of object as well as object key.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+stateLocation BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::Lookup(uint64_t hashKey, uint64_t &objKey) const
+{
+	if (table.Find(hashKey, objKey))
+		return hot[objKey].where;
+	if (compactedClosed.Contains(hashKey))
+	{
+		objKey = kTBDNoNode;
+		return kClosed;
+	}
+	return kUnseen;
+}
+
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+bool BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::LookupG(uint64_t hashKey, double &g) const
+{
+	uint64_t objKey;
+	if (table.Find(hashKey, objKey))
+	{
+		g = hot[objKey].g;
+		return true;
+	}
+	return compactedClosed.Find(hashKey, g);
+}
+
+/**
+ * Drop the records of all closed nodes, keeping only their hashes and
+ * g-costs; see BDOpenClosed::CompactClosed().
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+size_t BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::CompactClosed()
+{
+	std::vector<uint64_t> newID(hot.size(), kTBDNoNode);
+	size_t next = 0;
+	for (size_t x = 0; x < hot.size(); x++)
+		if (hot[x].where != kClosed)
+			newID[x] = next++;
+	size_t dropped = hot.size()-next;
+	if (dropped == 0)
+		return 0;
+
+	std::vector<std::pair<uint64_t, uint64_t>> kept;
+	kept.reserve(next);
+	table.ForEach([&](uint64_t hash, uint64_t id) {
+		if (newID[id] != kTBDNoNode)
+			kept.push_back(std::make_pair(hash, newID[id]));
+		else
+			compactedClosed.Insert(hash, hot[id].g);
+	});
+	table.Clear();
+	for (const auto &i : kept)
+		table.Insert(i.first, i.second);
+
+	for (size_t x = 0; x < hot.size(); x++)
+	{
+		if (newID[x] == kTBDNoNode)
+			continue;
+		hot[newID[x]] = hot[x];
+		states[newID[x]] = states[x];
+		parents[newID[x]] = parents[x];
+		pathCosts[newID[x]] = pathCosts[x];
+	}
+	hot.resize(next);
+	states.resize(next);
+	parents.resize(next);
+	pathCosts.resize(next);
+	BDShrinkCapacity(hot);
+	BDShrinkCapacity(states);
+	BDShrinkCapacity(parents);
+	BDShrinkCapacity(pathCosts);
+	for (uint64_t &p : parents)
+		if (p != kTBDNoNode)
+			p = newID[p];
+	for (int q = 0; q < 2; q++)
+		for (uint64_t &id : priorityQueues[q])
+			id = newID[id];
+	return dropped;
+}
+
+/**
+ * Peek at the next item to be expanded.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+uint64_t BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::Peek(stateLocation whichQueue) const
+{
+	assert(priorityQueues[whichQueue].size() != 0);
+	return priorityQueues[whichQueue][0];
+}
+
+/**
+ * Move the best item to the closed list and return key.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+uint64_t BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::Close()
+{
+	assert(OpenReadySize() != 0);
+
+	uint64_t ans = priorityQueues[kOpenReady][0];
+	hot[ans].where = kClosed;
+	priorityQueues[kOpenReady][0] = priorityQueues[kOpenReady].back();
+	hot[priorityQueues[kOpenReady][0]].openLocation = 0;
+	priorityQueues[kOpenReady].pop_back();
+
+	HeapifyDown(0, kOpenReady);
+
+	return ans;
+}
+
+/**
+ * Move the best item on the waiting queue to the ready queue and return key.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+uint64_t BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::PutToReady()
+{
+	assert(OpenWaitingSize() != 0);
+
+	uint64_t ans = priorityQueues[kOpenWaiting][0];
+	uint64_t back = priorityQueues[kOpenWaiting].back();
+	priorityQueues[kOpenWaiting][0] = back;
+	priorityQueues[kOpenWaiting].pop_back();
+	hot[back].openLocation = 0;
+	HeapifyDown(0, kOpenWaiting);
+
+	priorityQueues[kOpenReady].push_back(ans);
+	hot[ans].where = kOpenReady;
+	hot[ans].openLocation = priorityQueues[kOpenReady].size()-1;
+	HeapifyUp(priorityQueues[kOpenReady].size() - 1, kOpenReady);
+
+	return ans;
+}
+
+/**
+ * Move the best waiting node to the end of the ready queue without restoring
+ * the ready heap, so that a batch of nodes can be migrated for the cost of a
+ * single heap rebuild. RestoreReadyQueue() must be called before the ready
+ * queue is used again.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+uint64_t BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::PutToReadyDeferred()
+{
+	assert(OpenWaitingSize() != 0);
+	std::vector<uint64_t> &waiting = priorityQueues[kOpenWaiting];
+
+	uint64_t ans = waiting[0];
+	waiting[0] = waiting.back();
+	hot[waiting[0]].openLocation = 0;
+	waiting.pop_back();
+	HeapifyDown(0, kOpenWaiting);
+
+	priorityQueues[kOpenReady].push_back(ans);
+	hot[ans].where = kOpenReady;
+	hot[ans].openLocation = priorityQueues[kOpenReady].size()-1;
+	deferredReady++;
+	return ans;
+}
+
+/**
+ * Restore the ready heap after PutToReadyDeferred(). Large batches rebuild the
+ * heap bottom-up in O(n); small ones are sifted up one at a time.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+void BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::RestoreReadyQueue()
+{
+	std::vector<uint64_t> &ready = priorityQueues[kOpenReady];
+	size_t heapSize = ready.size()-deferredReady;
+	if (deferredReady > heapSize)
+	{
+		for (size_t x = ready.size()/2; x > 0; x--)
+			HeapifyDown(x-1, kOpenReady);
+	}
+	else {
+		for (size_t x = heapSize; x < ready.size(); x++)
+			HeapifyUp(x, kOpenReady);
+	}
+	deferredReady = 0;
+}
+
+/**
+ * Moves a node up the heap. Returns true if the node was moved, false otherwise.
+ */
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+template<typename compare>
+bool BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::HeapifyUp(unsigned int index, stateLocation whichQueue)
+{
+	std::vector<uint64_t> &queue = priorityQueues[whichQueue];
+	compare cmp;
+	bool moved = false;
+	while (index > 0)
+	{
+		unsigned int parent = (index-1)/2;
+		if (!cmp(hot[queue[parent]], hot[queue[index]]))
+			break;
+		std::swap(queue[parent], queue[index]);
+		hot[queue[parent]].openLocation = parent;
+		hot[queue[index]].openLocation = index;
+		index = parent;
+		moved = true;
+	}
+	return moved;
+}
+
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+template<typename compare>
+void BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::HeapifyDown(unsigned int index, stateLocation whichQueue)
+{
+	std::vector<uint64_t> &queue = priorityQueues[whichQueue];
+	compare cmp;
+	unsigned int count = queue.size();
+	while (true)
+	{
+		unsigned int child1 = index*2+1;
+		unsigned int child2 = index*2+2;
+		unsigned int which;
+		// find smallest child
+		if (child1 >= count)
+			return;
+		else if (child2 >= count)
+			which = child1;
+		else if (!cmp(hot[queue[child1]], hot[queue[child2]]))
+			which = child1;
+		else
+			which = child2;
+
+		if (cmp(hot[queue[which]], hot[queue[index]]))
+			return;
+		std::swap(queue[which], queue[index]);
+		hot[queue[which]].openLocation = which;
+		hot[queue[index]].openLocation = index;
+		index = which;
+	}
+}
+
+template<typename state, typename CmpKey0, typename CmpKey1, class indexTable>
+template<typename compare>
+bool BDOpenClosedSoA<state, CmpKey0, CmpKey1, indexTable>::Validate(stateLocation whichQueue) const
+{
+	const std::vector<uint64_t> &queue = priorityQueues[whichQueue];
+	compare cmp;
+	for (size_t x = 1; x < queue.size(); x++)
+	{
+		if (!cmp(hot[queue[x]], hot[queue[(x-1)/2]]))
+			return false;
+		if (hot[queue[x]].openLocation != x)
+			return false;
+	}
+	return true;
+}
+
+#endif
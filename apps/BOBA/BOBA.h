@@ -14,55 +14,99 @@
 #define BOBA_H
 
 #include "BDOpenClosed.h"
+#include "BDFrontIndex.h"
 #include "FPUtil.h"
-#include <unordered_map>
+#include "WorkerPool.h"
+#include "SearchTrace.h"
+#include <cmath>
+#include <functional>
+#include <map>
 
 #define EPSILON 1
 
 using std::cout;
+
+/**
+ * Cost comparison policies. BOBAFloatCosts compares with the FPUtil
+ * tolerance. BOBAIntegerCosts compares exactly, which is correct when all
+ * edge and heuristic costs are integers (still stored as doubles, which
+ * hold them exactly) and is cheaper than the tolerance tests.
+ */
+struct BOBAFloatCosts {
+	static inline bool Less(double a, double b) { return fless(a, b); }
+	static inline bool Greater(double a, double b) { return fgreater(a, b); }
+	static inline bool Equal(double a, double b) { return fequal(a, b); }
+};
+
+struct BOBAIntegerCosts {
+	static inline bool Less(double a, double b) { return a < b; }
+	static inline bool Greater(double a, double b) { return a > b; }
+	static inline bool Equal(double a, double b) { return a == b; }
+};
+
 //low g -> low f
-template <class state>
+template <class state, class costPolicy = BOBAFloatCosts>
 struct BOBACompareOpenReady {
-	bool operator()(const BDOpenClosedData<state> &i1, const BDOpenClosedData<state> &i2) const
+	// templated so that it also orders the hot records of BDOpenClosedSoA
+	template <class data>
+	bool operator()(const data &i1, const data &i2) const
 	{
 		double f1 = i1.g + i1.h;
 		double f2 = i2.g + i2.h;
 
-		if (fequal(i1.g, i2.g))
+		if (costPolicy::Equal(i1.g, i2.g))
 		{
-			return (!fless(f1, f2)); //equal g, low f over high
+			return (!costPolicy::Less(f1, f2)); //equal g, low f over high
 		}
-		return (fgreater(i1.g, i2.g)); // low g over high
+		return (costPolicy::Greater(i1.g, i2.g)); // low g over high
 	}
 };
 
-template <class state>
+template <class state, class costPolicy = BOBAFloatCosts>
 struct BOBACompareOpenWaiting {
-	bool operator()(const BDOpenClosedData<state> &i1, const BDOpenClosedData<state> &i2) const
+	// templated so that it also orders the hot records of BDOpenClosedSoA
+	template <class data>
+	bool operator()(const data &i1, const data &i2) const
 	{
 		double f1 = i1.g + i1.h;
 		double f2 = i2.g + i2.h;
 
-		if (fequal(f1, f2))
+		if (costPolicy::Equal(f1, f2))
 		{
-		    return (!fless(i1.g, i2.g)); // high g-cost over low
+		    return (!costPolicy::Less(i1.g, i2.g)); // high g-cost over low
 		}
-		return (fgreater(f1, f2)); // low f over high
+		return (costPolicy::Greater(f1, f2)); // low f over high
 	}
 };
 
-template <class state, class action, class environment,  class priorityQueue = BDOpenClosed<state, BOBACompareOpenReady<state>, BOBACompareOpenWaiting<state>>>
+// Search progress reported before each pair expansion
+struct BOBAStatus {
+	double lowerBound; // minPr of the pair about to be expanded
+	double solutionCost; // incumbent cost, DBL_MAX if none yet
+	double gap; // solutionCost-lowerBound
+	uint64_t nodesExpanded;
+};
+
+/**
+ * heuristicPolicy is any class with HCost(const state &, const state &);
+ * when its HCost is not virtual the calls are inlined into the search. If it
+ * also has HCostBounded, successors are evaluated only up to the incumbent.
+ * costPolicy selects how costs are compared, and should match the
+ * comparisons used by priorityQueue.
+ */
+template <class state, class action, class environment,  class priorityQueue = BDOpenClosed<state, BOBACompareOpenReady<state>, BOBACompareOpenWaiting<state>>,
+		  class heuristicPolicy = Heuristic<state>, class costPolicy = BOBAFloatCosts>
 class BOBA {
 public:
 	BOBA()
 	{
-		forwardHeuristic = 0; backwardHeuristic = 0; env = 0; ResetNodeCount();
+		forwardHeuristic = 0; backwardHeuristic = 0; env = 0; pool = 0; concurrentDirections = false; memoryLimit = 0; gapTolerance = 0; frontToFront = false; frontToFrontBudget = 0; batchHeuristic = false; ResetNodeCount();
 	}
-	virtual ~BOBA() {}
+	virtual ~BOBA() { delete pool; }
 	void GetPath(environment *env, const state& from, const state& to,
-				 Heuristic<state> *forward, Heuristic<state> *backward, std::vector<state> &thePath);
+				 heuristicPolicy *forward, heuristicPolicy *backward, std::vector<state> &thePath);
 	bool InitializeSearch(environment *env, const state& from, const state& to,
-						  Heuristic<state> *forward, Heuristic<state> *backward, std::vector<state> &thePath);
+						  heuristicPolicy *forward, heuristicPolicy *backward, std::vector<state> &thePath);
 	bool ExpandAPair(std::vector<state> &thePath);
 	bool DoSingleSearchStep(std::vector<state> &thePath);
 	
@@ -71,20 +115,42 @@ public:
 	
 	virtual const char *GetName() { return "BOBA"; }
 	
-	void ResetNodeCount() { nodesExpanded = nodesTouched = 0; counts.clear(); }
+	void ResetNodeCount()
+	{
+		nodesExpanded = nodesTouched = 0; integerCounts.clear(); realCounts.clear(); compactions = nodesCompacted = memorySaved = 0;
+		frontToFrontPrunes = frontToFrontEvaluations = 0;
+	}
 	
 //	bool GetClosedListGCost(const state &val, double &gCost) const;
 //	unsigned int GetNumOpenItems() { return openClosedList.OpenSize(); }
 //	inline const AStarOpenClosedData<state> &GetOpenItem(unsigned int which) { return openClosedList.Lookat(openClosedList.GetOpenItem(which)); }
 	inline const int GetNumForwardItems() { return forwardQueue.size(); }
-	inline const BDOpenClosedData<state> &GetForwardItem(unsigned int which) { return forwardQueue.Lookat(which); }
+	inline BDOpenClosedData<state> GetForwardItem(unsigned int which) { return forwardQueue.Lookat(which); }
 	inline const int GetNumBackwardItems() { return backwardQueue.size(); }
-	inline const BDOpenClosedData<state> &GetBackwardItem(unsigned int which) { return backwardQueue.Lookat(which); }
+	inline BDOpenClosedData<state> GetBackwardItem(unsigned int which) { return backwardQueue.Lookat(which); }
 //	bool HaveExpandedState(const state &val)
 //	{ uint64_t key; return openClosedList.Lookup(env->GetStateHash(val), key) != kNotFound; }
 //	
-	void SetForwardHeuristic(Heuristic<state> *h) { forwardHeuristic = h; }
-	void SetBackwardHeuristic(Heuristic<state> *h) { backwardHeuristic = h; }
+	void SetForwardHeuristic(heuristicPolicy *h) { forwardHeuristic = h; }
+	void SetBackwardHeuristic(heuristicPolicy *h) { backwardHeuristic = h; }
+	// Evaluate successor heuristics and queue lookups on this many threads.
+	// The heuristics must then be safe to call concurrently.
+	void SetNumThreads(int count)
+	{ delete pool; pool = (count > 1)?new WorkerPool(count):0; }
+	// Expand the forward and backward node of each pair at the same time.
+	// Needs at least two threads; the environment is still only used serially.
+	// Look up all successors of a node first, then evaluate the new ones with
+	// one BatchHCost call so that PDB lookups overlap. Batched values are
+	// exact, so they are not bounded by the incumbent. With concurrent
+	// directions each direction is one batch; otherwise the successors of a
+	// node are no longer split over threads.
+	void SetBatchHeuristic(bool batch) { batchHeuristic = batch; }
+	void SetConcurrentDirections(bool concurrent)
+	{
+		concurrentDirections = concurrent;
+		if (concurrent && (pool == 0 || pool->GetNumThreads() < 2))
+			SetNumThreads(2);
+	}
 	stateLocation GetNodeForwardLocation(const state &s) 
 	{
 		uint64_t childID;
@@ -98,84 +164,162 @@ public:
 	}
 	double GetNodeForwardG(const state& s)
 	{
-
-		uint64_t childID;
-		auto l = forwardQueue.Lookup(env->GetStateHash(s), childID);
-		if (l != kUnseen)
-			return forwardQueue.Lookat(childID).g;
+		double g;
+		if (forwardQueue.LookupG(env->GetStateHash(s), g))
+			return g;
 		return -1;
 	}
 	double GetNodeBackwardG(const state& s)
 	{
-
-		uint64_t childID;
-		auto l = backwardQueue.Lookup(env->GetStateHash(s), childID);
-		if (l != kUnseen)
-			return backwardQueue.Lookat(childID).g;
+		double g;
+		if (backwardQueue.LookupG(env->GetStateHash(s), g))
+			return g;
 		return -1;
 	}
 	uint64_t GetNodesExpanded() const { return nodesExpanded; }
 	uint64_t GetNodesTouched() const { return nodesTouched; }
+	// Pair expansions whose priority was below the solution cost. Each
+	// priority is compared exactly, so real-valued costs are counted too.
 	uint64_t GetNecessaryExpansions() const {
 		uint64_t necessary = 0;
-		for (const auto &i : counts)
+		for (size_t x = 0; x < integerCounts.size() && costPolicy::Less(x, currentCost); x++)
+			necessary += integerCounts[x];
+		for (const auto &i : realCounts)
 		{
-			if (i.first < currentCost)
-				necessary+=i.second;
+			if (!costPolicy::Less(i.first, currentCost))
+				break;
+			necessary += i.second;
 		}
 		return necessary;
 	}
 	double GetSolutionCost() const { return currentCost; }
+	double GetLowerBound() const { return lowerBound; }
+
+	// Called with the bounds before each pair expansion.
+	void SetStatusCallback(std::function<void(const BOBAStatus &)> f) { statusCallback = f; }
+	// Stop once the incumbent is within this much of the lower bound instead
+	// of proving it optimal. 0 (the default) returns an optimal solution.
+	void SetGapTolerance(double tolerance) { gapTolerance = tolerance; }
+
+	// When both queues together use more than this many bytes, the records of
+	// closed nodes are dropped, keeping only their hashes and g-costs for
+	// duplicate detection and path reconstruction. 0 means no limit.
+	void SetMemoryLimit(size_t bytes) { memoryLimit = bytes; }
+	size_t GetMemoryUsage() const { return forwardQueue.MemoryUsage()+backwardQueue.MemoryUsage(); }
+	uint64_t GetCompactions() const { return compactions; }
+	uint64_t GetNodesCompacted() const { return nodesCompacted; }
+	uint64_t GetMemorySaved() const { return memorySaved; }
+
+	// Once a solution is known, do not expand a node s unless some open node s'
+	// of the opposite direction has g(s)+h(s, s')+g(s') below its cost. The
+	// open nodes are indexed by g and h, so only those that can pass are
+	// visited, and the witness that let the parent through is tried first.
+	// The heuristics must be consistent and estimate the distance between any
+	// two states. A non-zero budget caps the evaluations of one test; when it
+	// runs out the node is expanded.
+	void SetFrontToFront(bool f2f, uint64_t budget = 0) { frontToFront = f2f; frontToFrontBudget = budget; }
+	// nodes not expanded because of front-to-front bounds
+	uint64_t GetFrontToFrontPrunes() const { return frontToFrontPrunes; }
+	// heuristic evaluations spent on front-to-front bounds
+	uint64_t GetFrontToFrontEvaluations() const { return frontToFrontEvaluations; }
 	//void FullBPMX(uint64_t nodeID, int distance);
 	
 	void OpenGLDraw() const;
 	
 //	void SetWeight(double w) {weight = w;}
 private:
+	// per-successor results of the read-only part of an expansion
+	struct successorInfo {
+		uint64_t hash, childID, reverseLoc;
+		stateLocation loc, oppositeLoc;
+		double edgeCost, oppositeG, h;
+	};
+	// the node being expanded in one direction and its successors
+	struct expansion {
+		uint64_t nextID;
+		std::vector<state> neighbors;
+		std::vector<successorInfo> successors;
+		// successors added or improved, checked for meetings the other
+		// direction missed when both directions expand concurrently
+		std::vector<size_t> changed;
+		double bestCost;
+		state middleNode;
+		uint64_t witness; // front-to-front witness of the expanded node
+		// node the opposite direction closed for the same pair, or kTBDNoNode
+		uint64_t oppositeNode;
+		// successors evaluated together, and their index in neighbors
+		std::vector<state> batch;
+		std::vector<size_t> batchIndex;
+		std::vector<double> batchH;
+	};
+	// front-to-front data of one direction: its open nodes by g and h, and
+	// the witness inherited by each node added to open
+	struct frontData {
+		BDFrontIndex index;
+		BDLinearProbeIndex witnesses;
+	};
+	frontData &FrontData(const priorityQueue &q) { return (&q == &forwardQueue)?forwardFront:backwardFront; }
+	const frontData &FrontData(const priorityQueue &q) const { return (&q == &forwardQueue)?forwardFront:backwardFront; }
+
 	void ExtractPathToGoal(state &node, std::vector<state> &thePath)
-	{ uint64_t theID; backwardQueue.Lookup(env->GetStateHash(node), theID); ExtractPathToGoalFromID(theID, thePath); }
-	void ExtractPathToGoalFromID(uint64_t node, std::vector<state> &thePath)
-	{
-		do {
-			thePath.push_back(backwardQueue.Lookup(node).data);
-			node = backwardQueue.Lookup(node).parentID;
-		} while (backwardQueue.Lookup(node).parentID != node);
-		thePath.push_back(backwardQueue.Lookup(node).data);
-	}
-	
+	{ ExtractPath(backwardQueue, goal, node, thePath); }
 	void ExtractPathToStart(state &node, std::vector<state> &thePath)
-	{ uint64_t theID; forwardQueue.Lookup(env->GetStateHash(node), theID); ExtractPathToStartFromID(theID, thePath); }
-	void ExtractPathToStartFromID(uint64_t node, std::vector<state> &thePath)
-	{
-		do {
-			thePath.push_back(forwardQueue.Lookup(node).data);
-			node = forwardQueue.Lookup(node).parentID;
-		} while (forwardQueue.Lookup(node).parentID != node);
-		thePath.push_back(forwardQueue.Lookup(node).data);
-	}
+	{ ExtractPath(forwardQueue, start, node, thePath); }
+	void ExtractPath(const priorityQueue &queue, const state &root, state node, std::vector<state> &thePath);
 
 	void OpenGLDraw(const priorityQueue &queue) const;
 	
 	void Expand(priorityQueue &current,
 				priorityQueue &opposite,
-				Heuristic<state> *heuristic, const state &target);
+				heuristicPolicy *heuristic, const state &target);
+	void ExpandConcurrently();
+	void CountExpansions(double priority, uint64_t count);
+	bool BeginExpansion(priorityQueue &current, const priorityQueue &opposite, heuristicPolicy *heuristic, expansion &e);
+	bool FrontToFrontBelow(const state &s, double g, const priorityQueue &opposite, heuristicPolicy *heuristic,
+						   uint64_t &witness, uint64_t &evaluations) const;
+	void LookupSuccessor(const priorityQueue &current, const priorityQueue &opposite, expansion &e, size_t which);
+	bool NeedsHeuristic(const successorInfo &info) const
+	{ return info.loc == kUnseen && info.oppositeLoc != kClosed; }
+	void EvaluateSuccessor(const priorityQueue &current, const priorityQueue &opposite,
+						   heuristicPolicy *heuristic, const state &target, expansion &e, size_t which);
+	void EvaluateSuccessorBatch(const priorityQueue &current, const priorityQueue &opposite,
+								heuristicPolicy *heuristic, const state &target, expansion &e);
+	void ApplySuccessors(priorityQueue &current, expansion &e);
+	void CheckMeetings(priorityQueue &current, const priorityQueue &opposite, expansion &e);
+	void CompactQueues();
 	//direction ==0 forward; 1 backward
 	//void Expand(int direction);
 	uint64_t nodesTouched, nodesExpanded;
+	size_t memoryLimit, nextCompaction;
+	uint64_t compactions, nodesCompacted, memorySaved;
 	state middleNode;
 	double currentCost;
 	double currentSolutionEstimate;
-	std::vector<state> neighbors;
+	expansion expansions[2];
+	WorkerPool *pool;
+	bool concurrentDirections;
 	environment *env;
-	std::unordered_map<double, int> counts;
+	// expansions by priority: integer priorities below kMaxIntegerPriority
+	// index a flat array, other priorities are keyed by their exact value
+	static const size_t kMaxIntegerPriority = 1<<16;
+	std::vector<uint64_t> integerCounts;
+	std::map<double, uint64_t> realCounts;
+	double lowerBound;
+	double gapTolerance;
+	std::function<void(const BOBAStatus &)> statusCallback;
+	bool frontToFront;
+	bool batchHeuristic;
+	uint64_t frontToFrontBudget;
+	frontData forwardFront, backwardFront;
+	uint64_t frontToFrontPrunes, frontToFrontEvaluations;
 
 	priorityQueue forwardQueue, backwardQueue;
 	//priorityQueue2 forwardQueue, backwardQueue;
 
 	state goal, start;
 
-	Heuristic<state> *forwardHeuristic;
-	Heuristic<state> *backwardHeuristic;
+	heuristicPolicy *forwardHeuristic;
+	heuristicPolicy *backwardHeuristic;
 
 	//keep track of whether we expand a node or put it back to open
 	bool expand;
@@ -185,9 +329,9 @@ private:
 
 };
 
-template <class state, class action, class environment, class priorityQueue>
-void BOBA<state, action, environment, priorityQueue>::GetPath(environment *env, const state& from, const state& to,
-			 Heuristic<state> *forward, Heuristic<state> *backward, std::vector<state> &thePath)
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::GetPath(environment *env, const state& from, const state& to,
+			 heuristicPolicy *forward, heuristicPolicy *backward, std::vector<state> &thePath)
 {
 	if (InitializeSearch(env, from, to, forward, backward, thePath) == false)
 		return;
@@ -196,9 +340,9 @@ void BOBA<state, action, environment, priorityQueue>::GetPath(environment *env,
 	{ }
 }
 
-template <class state, class action, class environment, class priorityQueue>
-bool BOBA<state, action, environment, priorityQueue>::InitializeSearch(environment *env, const state& from, const state& to,
-																	 Heuristic<state> *forward, Heuristic<state> *backward,
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+bool BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::InitializeSearch(environment *env, const state& from, const state& to,
+																	 heuristicPolicy *forward, heuristicPolicy *backward,
 																	 std::vector<state> &thePath)
 {
 	this->env = env;
@@ -206,23 +350,35 @@ bool BOBA<state, action, environment, priorityQueue>::InitializeSearch(environme
 	backwardHeuristic = backward;
 	currentSolutionEstimate = 0;
 	currentCost = DBL_MAX;
+	lowerBound = 0;
 	forwardQueue.Reset();
 	backwardQueue.Reset();
 	ResetNodeCount();
+	nextCompaction = memoryLimit;
 	thePath.resize(0);
 	start = from;
 	goal = to;
 	if (start == goal)
 		return false;
 
-	forwardQueue.AddOpenNode(start, env->GetStateHash(start), 0, forwardHeuristic->HCost(start, goal));
-	backwardQueue.AddOpenNode(goal, env->GetStateHash(goal), 0, backwardHeuristic->HCost(goal, start));
+	uint64_t startID = forwardQueue.AddOpenNode(start, env->GetStateHash(start), 0, forwardHeuristic->HCost(start, goal));
+	uint64_t goalID = backwardQueue.AddOpenNode(goal, env->GetStateHash(goal), 0, backwardHeuristic->HCost(goal, start));
+	for (frontData *f : {&forwardFront, &backwardFront})
+	{
+		f->index.Clear();
+		f->witnesses.Clear();
+	}
+	if (frontToFront)
+	{
+		forwardFront.index.Add(startID, 0, forwardQueue.Lookat(startID).h);
+		backwardFront.index.Add(goalID, 0, backwardQueue.Lookat(goalID).h);
+	}
 
 	return true;
 }
 
-template <class state, class action, class environment, class priorityQueue>
-bool BOBA<state, action, environment, priorityQueue>::ExpandAPair(std::vector<state> &thePath)
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+bool BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::ExpandAPair(std::vector<state> &thePath)
 {
 	
 	if (forwardQueue.OpenSize() == 0 || backwardQueue.OpenSize() == 0)
@@ -239,22 +395,31 @@ bool BOBA<state, action, environment, priorityQueue>::ExpandAPair(std::vector<st
 		}
 		return true;
 	}
+
+	if (memoryLimit != 0 && GetMemoryUsage() > nextCompaction)
+		CompactQueues();
+	if (frontToFront && forwardFront.index.Entries() > 2*forwardQueue.OpenSize()+1024)
+		forwardFront.index.Rebuild(forwardQueue);
+	if (frontToFront && backwardFront.index.Entries() > 2*backwardQueue.OpenSize()+1024)
+		backwardFront.index.Rebuild(backwardQueue);
 	
 	uint64_t nextIDForward;
 	uint64_t nextIDBackward;
 	BDOpenClosedData<state> iFReady, iBReady, iFWaiting, iBWaiting;
 	
+	// Nothing below peeks at the ready heaps until they are restored, so
+	// waiting nodes are moved over as one batch.
 	if (forwardQueue.OpenReadySize() == 0)
-		forwardQueue.PutToReady();
+		forwardQueue.PutToReadyDeferred();
 	if (backwardQueue.OpenReadySize() == 0)
-		backwardQueue.PutToReady();
+		backwardQueue.PutToReadyDeferred();
 	
 	if (forwardQueue.OpenWaitingSize() > 0)
 	{
 		iFWaiting = forwardQueue.Lookat(forwardQueue.Peek(kOpenWaiting));
 		while (iFWaiting.g+iFWaiting.h < currentSolutionEstimate)
 		{
-			forwardQueue.PutToReady();
+			forwardQueue.PutToReadyDeferred();
 			if (forwardQueue.OpenWaitingSize()  == 0)
 				break;
 			iFWaiting = forwardQueue.Lookat(forwardQueue.Peek(kOpenWaiting));
@@ -265,12 +430,14 @@ bool BOBA<state, action, environment, priorityQueue>::ExpandAPair(std::vector<st
 		iBWaiting = backwardQueue.Lookat(backwardQueue.Peek(kOpenWaiting));
 		while (iBWaiting.g+iBWaiting.h < currentSolutionEstimate)
 		{
-			backwardQueue.PutToReady();
+			backwardQueue.PutToReadyDeferred();
 			if (backwardQueue.OpenWaitingSize()  == 0)
 				break;
 			iBWaiting = backwardQueue.Lookat(backwardQueue.Peek(kOpenWaiting));
 		}
 	}
+	forwardQueue.RestoreReadyQueue();
+	backwardQueue.RestoreReadyQueue();
 
 	iFReady = forwardQueue.Lookat(forwardQueue.Peek(kOpenReady));
 	iBReady = backwardQueue.Lookat(backwardQueue.Peek(kOpenReady));
@@ -297,22 +464,25 @@ bool BOBA<state, action, environment, priorityQueue>::ExpandAPair(std::vector<st
 			fBound = std::min(iFWaiting.g + iFWaiting.h, iBWaiting.g + iBWaiting.h);
 		}
 		
-		while (fgreater(gBound, fBound))
+		// The ready heaps are only restored after the whole batch has moved;
+		// the smallest ready g is tracked here instead of peeking each time.
+		double gForward = iFReady.g, gBackward = iBReady.g;
+		while (costPolicy::Greater(gBound, fBound))
 		{
 			if (forwardQueue.OpenWaitingSize() == 0)
-				backwardQueue.PutToReady();
+				gBackward = std::min(gBackward, backwardQueue.Lookat(backwardQueue.PutToReadyDeferred()).g);
 			else if (backwardQueue.OpenWaitingSize() == 0)
-				forwardQueue.PutToReady();
+				gForward = std::min(gForward, forwardQueue.Lookat(forwardQueue.PutToReadyDeferred()).g);
 			else
 			{
 				nextIDForward = forwardQueue.Peek(kOpenWaiting);
 				nextIDBackward = backwardQueue.Peek(kOpenWaiting);
 				auto iF = forwardQueue.Lookat(nextIDForward);
 				auto iB = backwardQueue.Lookat(nextIDBackward);
-				if (fless(iF.g + iF.h, iB.g + iB.h))
-					forwardQueue.PutToReady();
+				if (costPolicy::Less(iF.g + iF.h, iB.g + iB.h))
+					gForward = std::min(gForward, forwardQueue.Lookat(forwardQueue.PutToReadyDeferred()).g);
 				else
-					backwardQueue.PutToReady();
+					gBackward = std::min(gBackward, backwardQueue.Lookat(backwardQueue.PutToReadyDeferred()).g);
 			}
 			
 			if (forwardQueue.OpenWaitingSize() == 0 && backwardQueue.OpenWaitingSize() == 0)
@@ -336,10 +506,10 @@ bool BOBA<state, action, environment, priorityQueue>::ExpandAPair(std::vector<st
 				fBound = std::min(iFWaiting.g + iFWaiting.h, iBWaiting.g + iBWaiting.h);
 				//TODO epsilon
 			}
-			iFReady = forwardQueue.Lookat(forwardQueue.Peek(kOpenReady));
-			iBReady = backwardQueue.Lookat(backwardQueue.Peek(kOpenReady));
-			gBound = iFReady.g + iBReady.g + EPSILON;
+			gBound = gForward + gBackward + EPSILON;
 		}
+		forwardQueue.RestoreReadyQueue();
+		backwardQueue.RestoreReadyQueue();
 		currentSolutionEstimate = fBound;
 		iFReady = forwardQueue.Lookat(forwardQueue.Peek(kOpenReady));
 		iBReady = backwardQueue.Lookat(backwardQueue.Peek(kOpenReady));
@@ -361,7 +531,10 @@ bool BOBA<state, action, environment, priorityQueue>::ExpandAPair(std::vector<st
 	}
 	double minPr = std::max(iFReady.g + iFReady.h, iBReady.g + iBReady.h);
 	minPr = std::max(minPr, iFReady.g + iBReady.g + EPSILON);
-	if (!fless(minPr, currentCost)) // terminate - priority >= incumbant solution
+	lowerBound = minPr;
+	if (statusCallback)
+		statusCallback({minPr, currentCost, currentCost-minPr, nodesExpanded});
+	if (!costPolicy::Less(minPr+gapTolerance, currentCost)) // terminate - priority (plus tolerance) >= incumbant solution
 	{
 		if (currentCost != DBL_MAX)
 		{
@@ -374,10 +547,16 @@ bool BOBA<state, action, environment, priorityQueue>::ExpandAPair(std::vector<st
 		}
 		return true;
 	}
-	counts[minPr]+=2; // 2 expansions
+	CountExpansions(minPr, 2);
 	//printf("Expanding F_f = %f; F_b = %f; g+g+epsilon=%f\n", iFReady.g+iFReady.h, iBReady.g + iBReady.h, iFReady.g + iBReady.g + EPSILON);
-	Expand(forwardQueue, backwardQueue, forwardHeuristic, goal);
-	Expand(backwardQueue, forwardQueue, backwardHeuristic, start);
+	if (concurrentDirections && pool)
+	{
+		ExpandConcurrently();
+	}
+	else {
+		Expand(forwardQueue, backwardQueue, forwardHeuristic, goal);
+		Expand(backwardQueue, forwardQueue, backwardHeuristic, start);
+	}
 	return false;
 	
 	
@@ -386,35 +565,287 @@ bool BOBA<state, action, environment, priorityQueue>::ExpandAPair(std::vector<st
 
 
 
-template <class state, class action, class environment, class priorityQueue>
-bool BOBA<state, action, environment, priorityQueue>::DoSingleSearchStep(std::vector<state> &thePath)
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+bool BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::DoSingleSearchStep(std::vector<state> &thePath)
 {
 	return ExpandAPair(thePath);
 }
 
 
-template <class state, class action, class environment, class priorityQueue>
-void BOBA<state, action, environment, priorityQueue>::Expand(priorityQueue &current,
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::Expand(priorityQueue &current,
 														   priorityQueue &opposite,
-														   Heuristic<state> *heuristic, const state &target)
+														   heuristicPolicy *heuristic, const state &target)
 {
+	expansion &e = expansions[0];
+	if (!BeginExpansion(current, opposite, heuristic, e))
+		return;
+	nodesExpanded++;
+	nodesTouched += e.neighbors.size();
 
-	uint64_t nextID = current.Peek(kOpenReady);
-	
-	nextID = current.Close();
+	// Neither queue changes until all successors have been looked up and the
+	// new ones given a heuristic value, so this part can run in parallel.
+	auto evaluate = [&](size_t x, int) { EvaluateSuccessor(current, opposite, heuristic, target, e, x); };
+	if (batchHeuristic)
+		EvaluateSuccessorBatch(current, opposite, heuristic, target, e);
+	else if (pool)
+		pool->ParallelFor(e.neighbors.size(), evaluate);
+	else {
+		for (size_t x = 0; x < e.neighbors.size(); x++)
+			evaluate(x, 0);
+	}
 
-	//this can happen when we expand a single node instead of a pair
-	if (!fless(current.Lookup(nextID).g + current.Lookup(nextID).h, currentCost))
+	e.bestCost = currentCost;
+	ApplySuccessors(current, e);
+	if (costPolicy::Less(e.bestCost, currentCost))
+	{
+		currentCost = e.bestCost;
+		middleNode = e.middleNode;
+	}
+}
+
+/**
+ * Record expansions made at a priority for GetNecessaryExpansions. A
+ * priority that is not finite can never be below the solution cost.
+ */
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::CountExpansions(double priority, uint64_t count)
+{
+	if (!std::isfinite(priority))
 		return;
+	if (priority >= 0 && priority < kMaxIntegerPriority && priority == std::floor(priority))
+	{
+		size_t bin = (size_t)priority;
+		if (bin >= integerCounts.size())
+			integerCounts.resize(bin+1);
+		integerCounts[bin] += count;
+	}
+	else {
+		realCounts[priority] += count;
+	}
+}
 
-	nodesExpanded++;
+/**
+ * Expand the forward and backward node of a pair at the same time. Both nodes
+ * are closed first, then all successors are looked up while neither queue
+ * changes. Each direction then updates only its own queue, using the values
+ * of the opposite queue seen during the lookup. Finally the new incumbents
+ * and any meetings between nodes generated in the same pair are merged in a
+ * fixed order, so the result does not depend on thread timing.
+ */
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::ExpandConcurrently()
+{
+	expansion &f = expansions[0];
+	expansion &b = expansions[1];
+	bool expandForward = BeginExpansion(forwardQueue, backwardQueue, forwardHeuristic, f);
+	bool expandBackward = BeginExpansion(backwardQueue, forwardQueue, backwardHeuristic, b);
+	// each node was open when the pair was chosen, so it still meets the
+	// successors of the other node
+	f.oppositeNode = b.nextID;
+	b.oppositeNode = f.nextID;
+	size_t forwardCount = f.neighbors.size();
+	size_t backwardCount = b.neighbors.size();
+	nodesExpanded += (expandForward?1:0)+(expandBackward?1:0);
+	nodesTouched += forwardCount+backwardCount;
 
-	env->GetSuccessors(current.Lookup(nextID).data, neighbors);
-	for (auto &succ : neighbors)
+	if (batchHeuristic)
 	{
-		nodesTouched++;
-		uint64_t childID;
-		auto loc = current.Lookup(env->GetStateHash(succ), childID);
+		pool->ParallelFor(2, [&](size_t x, int) {
+			if (x == 0)
+				EvaluateSuccessorBatch(forwardQueue, backwardQueue, forwardHeuristic, goal, f);
+			else
+				EvaluateSuccessorBatch(backwardQueue, forwardQueue, backwardHeuristic, start, b);
+		});
+	}
+	else {
+		pool->ParallelFor(forwardCount+backwardCount, [&](size_t x, int) {
+			if (x < forwardCount)
+				EvaluateSuccessor(forwardQueue, backwardQueue, forwardHeuristic, goal, f, x);
+			else
+				EvaluateSuccessor(backwardQueue, forwardQueue, backwardHeuristic, start, b, x-forwardCount);
+		});
+	}
+
+	f.bestCost = b.bestCost = currentCost;
+	pool->ParallelFor(2, [&](size_t x, int) {
+		if (x == 0)
+			ApplySuccessors(forwardQueue, f);
+		else
+			ApplySuccessors(backwardQueue, b);
+	});
+
+	for (expansion *e : {&f, &b})
+	{
+		if (costPolicy::Less(e->bestCost, currentCost))
+		{
+			currentCost = e->bestCost;
+			middleNode = e->middleNode;
+		}
+	}
+	CheckMeetings(forwardQueue, backwardQueue, f);
+	CheckMeetings(backwardQueue, forwardQueue, b);
+}
+
+/**
+ * Close the best ready node and generate its successors. Returns false if
+ * the node cannot lead to a better solution and is not expanded.
+ */
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+bool BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::BeginExpansion(priorityQueue &current, const priorityQueue &opposite,
+																	heuristicPolicy *heuristic, expansion &e)
+{
+	e.nextID = current.Close();
+	e.neighbors.resize(0);
+	e.changed.resize(0);
+	e.witness = kTBDNoNode;
+	e.oppositeNode = kTBDNoNode;
+
+	//this can happen when we expand a single node instead of a pair
+	if (!costPolicy::Less(current.Lookup(e.nextID).g + current.Lookup(e.nextID).h, currentCost))
+		return false;
+
+	if (frontToFront && currentCost != DBL_MAX)
+	{
+		const auto &i = current.Lookat(e.nextID);
+		uint64_t evaluations = 0;
+		FrontData(current).witnesses.Find(e.nextID, e.witness);
+		bool below = FrontToFrontBelow(i.data, i.g, opposite, heuristic, e.witness, evaluations);
+		frontToFrontEvaluations += evaluations;
+		if (!below)
+		{
+			frontToFrontPrunes++;
+			return false;
+		}
+	}
+
+	SEARCH_TRACE_EXPANSION((&current == &forwardQueue)?kTraceForward:kTraceBackward, kOpenReady,
+						   current.Lookat(e.nextID).g, current.Lookat(e.nextID).h,
+						   current.Lookat(e.nextID).g+current.Lookat(e.nextID).h,
+						   env->GetStateHash(current.Lookat(e.nextID).data));
+
+	// the environment may keep scratch state, so it is only used here
+	env->GetSuccessors(current.Lookup(e.nextID).data, e.neighbors);
+	e.successors.resize(e.neighbors.size());
+	for (size_t x = 0; x < e.neighbors.size(); x++)
+	{
+		e.successors[x].hash = env->GetStateHash(e.neighbors[x]);
+		e.successors[x].edgeCost = env->GCost(current.Lookup(e.nextID).data, e.neighbors[x]);
+	}
+	return true;
+}
+
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::LookupSuccessor(const priorityQueue &current, const priorityQueue &opposite,
+																	expansion &e, size_t which)
+{
+	successorInfo &info = e.successors[which];
+	info.loc = current.Lookup(info.hash, info.childID);
+	info.oppositeLoc = opposite.Lookup(info.hash, info.reverseLoc);
+	// a serial expansion would still find the node of the opposite half of
+	// the pair open; CheckMeetings removes the successor afterwards.
+	// Compacted nodes are closed with id kTBDNoNode, as is oppositeNode when
+	// the pair is expanded serially, so that id never matches.
+	if (info.oppositeLoc == kClosed && e.oppositeNode != kTBDNoNode && info.reverseLoc == e.oppositeNode)
+		info.oppositeLoc = kOpenReady;
+	if (info.oppositeLoc == kOpenReady || info.oppositeLoc == kOpenWaiting)
+		info.oppositeG = opposite.Lookat(info.reverseLoc).g;
+}
+
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::EvaluateSuccessor(const priorityQueue &current, const priorityQueue &opposite,
+																	  heuristicPolicy *heuristic, const state &target, expansion &e, size_t which)
+{
+	LookupSuccessor(current, opposite, e, which);
+	successorInfo &info = e.successors[which];
+	if (NeedsHeuristic(info))
+	{
+		// the node is only added if g+h is below the incumbent, which does
+		// not change until the successors are applied
+		double g = current.Lookat(e.nextID).g+info.edgeCost;
+		info.h = BoundedHCost(heuristic, e.neighbors[which], target, currentCost-g-TOLERANCE);
+	}
+}
+
+/**
+ * Look up every successor of e, then evaluate the heuristic of those that
+ * need one with a single batch call. Only reads the queues.
+ */
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::EvaluateSuccessorBatch(const priorityQueue &current, const priorityQueue &opposite,
+																		   heuristicPolicy *heuristic, const state &target, expansion &e)
+{
+	e.batch.resize(0);
+	e.batchIndex.resize(0);
+	for (size_t x = 0; x < e.neighbors.size(); x++)
+	{
+		LookupSuccessor(current, opposite, e, x);
+		if (NeedsHeuristic(e.successors[x]))
+		{
+			e.batch.push_back(e.neighbors[x]);
+			e.batchIndex.push_back(x);
+		}
+	}
+	e.batchH.resize(e.batch.size());
+	if (e.batch.size() > 0)
+		BatchedHCost(heuristic, &e.batch[0], e.batch.size(), target, &e.batchH[0]);
+	for (size_t x = 0; x < e.batch.size(); x++)
+		e.successors[e.batchIndex[x]].h = e.batchH[x];
+}
+
+/**
+ * Whether some open node s' of the opposite queue has g+h(s, s')+g(s') below
+ * the incumbent cost. The witness passed in is tried first, and is replaced
+ * by the node found in the index. Only reads the queues and the index.
+ */
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+bool BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::FrontToFrontBelow(const state &s, double g, const priorityQueue &opposite,
+																	  heuristicPolicy *heuristic, uint64_t &witness, uint64_t &evaluations) const
+{
+	auto below = [&](uint64_t id) {
+		const auto &i = opposite.Lookat(id);
+		evaluations++;
+		return costPolicy::Less(g+BoundedHCost(heuristic, s, i.data, currentCost-g-i.g-TOLERANCE)+i.g, currentCost);
+	};
+	if (witness != kTBDNoNode && witness < opposite.size())
+	{
+		stateLocation where = opposite.Lookat(witness).where;
+		if ((where == kOpenReady || where == kOpenWaiting) && below(witness))
+			return true;
+	}
+	// the opposite nodes store h towards the target of their direction
+	bool forward = (&opposite == &backwardQueue);
+	double h = forward?backwardHeuristic->HCost(s, start):forwardHeuristic->HCost(s, goal);
+	evaluations++;
+	uint64_t limit = evaluations+frontToFrontBudget;
+	return FrontData(opposite).index.Any(opposite, currentCost-g, h, [&](uint64_t id) {
+		if (frontToFrontBudget != 0 && evaluations >= limit)
+			return true; // give up; s is kept
+		if (!below(id))
+			return false;
+		witness = id;
+		return true;
+	});
+}
+
+/**
+ * Add or update the successors in the current queue. Only the current queue
+ * is written; the opposite queue is only seen through the lookup results.
+ */
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::ApplySuccessors(priorityQueue &current, expansion &e)
+{
+	double parentG = current.Lookup(e.nextID).g;
+	for (size_t x = 0; x < e.neighbors.size(); x++)
+	{
+		const state &succ = e.neighbors[x];
+		successorInfo &info = e.successors[x];
+		uint64_t childID = info.childID;
+		auto loc = info.loc;
+		// an earlier successor may have been the same state
+		if (loc == kUnseen)
+			loc = current.Lookup(info.hash, childID);
+		bool oppositeOpen = (info.oppositeLoc == kOpenReady || info.oppositeLoc == kOpenWaiting);
 		switch (loc)
 		{
 			case kClosed: // ignore
@@ -422,33 +853,25 @@ void BOBA<state, action, environment, priorityQueue>::Expand(priorityQueue &curr
 			case kOpenReady: // update cost if needed
 			case kOpenWaiting:
 			{
-				double edgeCost = env->GCost(current.Lookup(nextID).data, succ);
-				if (fless(current.Lookup(nextID).g+edgeCost, current.Lookup(childID).g))
+				if (costPolicy::Less(parentG+info.edgeCost, current.Lookup(childID).g))
 				{
-					double oldGCost = current.Lookup(childID).g;
-					current.Lookup(childID).parentID = nextID;
-					current.Lookup(childID).g = current.Lookup(nextID).g+edgeCost;
+					current.Lookup(childID).parentID = e.nextID;
+					current.Lookup(childID).g = parentG+info.edgeCost;
 					current.KeyChanged(childID);
+					if (frontToFront)
+						FrontData(current).index.Add(childID, parentG+info.edgeCost, current.Lookat(childID).h);
+					info.childID = childID;
+					e.changed.push_back(x);
 
-					// TODO: check if we improved the current solution?
-					uint64_t reverseLoc;
-					auto loc = opposite.Lookup(env->GetStateHash(succ), reverseLoc);
-					if (loc == kOpenReady || loc == kOpenWaiting)
+					if (oppositeOpen)
 					{
-						if (fless(current.Lookup(nextID).g+edgeCost + opposite.Lookup(reverseLoc).g, currentCost))
+						if (costPolicy::Less(parentG+info.edgeCost+info.oppositeG, e.bestCost))
 						{
-							// TODO: store current solution
-//							printf("BOBA Potential updated solution found, cost: %1.2f + %1.2f = %1.2f (%llu nodes)\n",
-//								   current.Lookup(nextID).g+edgeCost,
-//								   opposite.Lookup(reverseLoc).g,
-//								   current.Lookup(nextID).g+edgeCost+opposite.Lookup(reverseLoc).g,
-//								nodesExpanded);
-							currentCost = current.Lookup(nextID).g+edgeCost + opposite.Lookup(reverseLoc).g;
-
-							middleNode = succ;
+							e.bestCost = parentG+info.edgeCost+info.oppositeG;
+							e.middleNode = succ;
 						}
 					}
-					else if (loc == kClosed)
+					else if (info.oppositeLoc == kClosed)
 					{
 						current.Remove(childID);
 					}
@@ -457,69 +880,152 @@ void BOBA<state, action, environment, priorityQueue>::Expand(priorityQueue &curr
 				break;
 			case kUnseen:
 			{
-				uint64_t reverseLoc;
-				auto loc = opposite.Lookup(env->GetStateHash(succ), reverseLoc);
-				if (loc == kClosed)// then 
+				if (info.oppositeLoc == kClosed)
 				{
 					break;			//do nothing. do not put this node to open
 				}
-				else//loc == kUnseen
+				double newNodeF = parentG + info.edgeCost + info.h;
+				if (costPolicy::Less(newNodeF, e.bestCost))
 				{
-					double edgeCost = env->GCost(current.Lookup(nextID).data, succ);
-
-					double newNodeF = current.Lookup(nextID).g + edgeCost + heuristic->HCost(succ, target);
-					if (fless(newNodeF , currentCost))
+					info.childID = current.AddOpenNode(succ,
+													   info.hash,
+													   parentG + info.edgeCost,
+													   info.h,
+													   e.nextID,
+													   costPolicy::Less(newNodeF, currentSolutionEstimate)?kOpenReady:kOpenWaiting);
+					e.changed.push_back(x);
+					if (frontToFront)
 					{
-						if (fless(newNodeF, currentSolutionEstimate))
-							current.AddOpenNode(succ,
-												env->GetStateHash(succ),
-												current.Lookup(nextID).g + edgeCost,
-												heuristic->HCost(succ, target),
-												nextID, kOpenReady);
-						else
-							current.AddOpenNode(succ,
-											env->GetStateHash(succ),
-											current.Lookup(nextID).g + edgeCost,
-											heuristic->HCost(succ, target),
-											nextID, kOpenWaiting);
-
-					}
-					if (loc == kOpenReady || loc == kOpenWaiting)
-					{
-						double edgeCost = env->GCost(current.Lookup(nextID).data, succ);
-						if (fless(current.Lookup(nextID).g + edgeCost + opposite.Lookup(reverseLoc).g, currentCost))
-						{
-							// TODO: store current solution
-//							printf("BOBA Potential solution found, cost: %1.2f + %1.2f = %1.2f (%llu nodes)\n",
-//								current.Lookup(nextID).g + edgeCost,
-//								opposite.Lookup(reverseLoc).g,
-//								current.Lookup(nextID).g + edgeCost + opposite.Lookup(reverseLoc).g,
-//								nodesExpanded);
-							currentCost = current.Lookup(nextID).g + edgeCost + opposite.Lookup(reverseLoc).g;
-
-							middleNode = succ;
-						}
-
+						FrontData(current).index.Add(info.childID, parentG+info.edgeCost, info.h);
+						// a witness of the parent is usually one of the child
+						if (e.witness != kTBDNoNode)
+							FrontData(current).witnesses.Insert(info.childID, e.witness);
 					}
 				}
-
+				if (oppositeOpen && costPolicy::Less(parentG + info.edgeCost + info.oppositeG, e.bestCost))
+				{
+					e.bestCost = parentG + info.edgeCost + info.oppositeG;
+					e.middleNode = succ;
+				}
 			}
 			break;
 		}
 	}
 }
 
+/**
+ * After a concurrent pair, compare the nodes one direction added or improved
+ * with the current state of the other queue and update the incumbent with
+ * new meetings. Nodes the other direction has closed are met there too, and
+ * then dropped.
+ */
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::CheckMeetings(priorityQueue &current, const priorityQueue &opposite, expansion &e)
+{
+	for (size_t x : e.changed)
+	{
+		const successorInfo &info = e.successors[x];
+		stateLocation where = current.Lookat(info.childID).where;
+		if (where != kOpenReady && where != kOpenWaiting)
+			continue;
+		uint64_t reverseLoc;
+		stateLocation loc = opposite.Lookup(info.hash, reverseLoc);
+		if (loc == kUnseen)
+			continue;
+		// other closed nodes may have been compacted, and were already
+		// closed when the successor was looked up
+		if (loc != kClosed || (e.oppositeNode != kTBDNoNode && reverseLoc == e.oppositeNode))
+		{
+			double cost = current.Lookat(info.childID).g + opposite.Lookat(reverseLoc).g;
+			if (costPolicy::Less(cost, currentCost))
+			{
+				currentCost = cost;
+				middleNode = e.neighbors[x];
+			}
+		}
+		if (loc == kClosed)
+			current.Remove(info.childID);
+	}
+}
+
+
 
+/**
+ * Drop closed records from both queues. Paths through dropped nodes are
+ * rebuilt from their g-costs by ExtractPath. The next compaction waits until
+ * the queues have grown by half again, so that a budget that is too small
+ * does not cause a compaction on every expansion.
+ */
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::CompactQueues()
+{
+	size_t before = GetMemoryUsage();
+	nodesCompacted += forwardQueue.CompactClosed();
+	nodesCompacted += backwardQueue.CompactClosed();
+	if (frontToFront)
+	{
+		// element ids have changed
+		for (frontData *f : {&forwardFront, &backwardFront})
+			f->witnesses.Clear();
+		forwardFront.index.Rebuild(forwardQueue);
+		backwardFront.index.Rebuild(backwardQueue);
+	}
+	size_t after = GetMemoryUsage();
+	compactions++;
+	if (after < before)
+		memorySaved += before-after;
+	nextCompaction = std::max(memoryLimit, after+after/2);
+}
+
+/**
+ * Walk from node back to root, the start or goal of queue. Parent pointers
+ * are followed where the record has one. Otherwise the predecessor is
+ * regenerated as a neighbor whose g-cost plus the edge cost equals the
+ * node's g-cost; any such neighbor lies on a path of the same cost. Like the
+ * backward search, this assumes that successors are also predecessors.
+ */
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::ExtractPath(const priorityQueue &queue, const state &root,
+																 state node, std::vector<state> &thePath)
+{
+	std::vector<state> neighbors;
+	while (true)
+	{
+		thePath.push_back(node);
+		if (node == root)
+			return;
+		uint64_t hash = env->GetStateHash(node);
+		uint64_t id;
+		if (queue.Lookup(hash, id) != kUnseen && id != kTBDNoNode && queue.Lookat(id).parentID != kTBDNoNode)
+		{
+			node = queue.Lookat(queue.Lookat(id).parentID).data;
+			continue;
+		}
+		double g, parentG;
+		bool found = queue.LookupG(hash, g);
+		assert(found);
+		env->GetSuccessors(node, neighbors);
+		size_t x;
+		for (x = 0; x < neighbors.size(); x++)
+		{
+			if (queue.LookupG(env->GetStateHash(neighbors[x]), parentG) &&
+				costPolicy::Equal(parentG+env->GCost(neighbors[x], node), g))
+				break;
+		}
+		assert(x < neighbors.size());
+		node = neighbors[x];
+	}
+}
 
-template <class state, class action, class environment, class priorityQueue>
-void BOBA<state, action, environment, priorityQueue>::OpenGLDraw() const
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::OpenGLDraw() const
 {
 	OpenGLDraw(forwardQueue);
 	OpenGLDraw(backwardQueue);
 }
 
-template <class state, class action, class environment, class priorityQueue>
-void BOBA<state, action, environment, priorityQueue>::OpenGLDraw(const priorityQueue &queue) const
+template <class state, class action, class environment, class priorityQueue, class heuristicPolicy, class costPolicy>
+void BOBA<state, action, environment, priorityQueue, heuristicPolicy, costPolicy>::OpenGLDraw(const priorityQueue &queue) const
 {
 	double transparency = 0.9;
 	if (queue.size() == 0)
@@ -0,0 +1,436 @@
+/*
+ *  Benchmark.cpp
+ *
+ *  Headless batch runner for the grid map experiments of the BOBA driver.
+ *  Every scenario in a directory is solved with A*, MM and BOBA; scenarios
+ *  are spread over a pool of threads, each with its own copy of the map,
+ *  and the per-instance results are written as CSV and/or JSON.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/resource.h>
+
+#include "Map2DEnvironment.h"
+#include "ScenarioLoader.h"
+#include "TemplateAStar.h"
+#include "MM.h"
+#include "BOBA.h"
+#include "WorkerPool.h"
+
+#define SQUARE_ROOT_OF2 1.414213562373
+
+enum benchAlg {
+	kBenchAStar = 0,
+	kBenchMM = 1,
+	kBenchBOBA = 2,
+	kBenchBOBAF2F = 3, // BOBA with front-to-front pruning; only run when asked for
+	kNumBenchAlgs = 4
+};
+
+const char *algNames[kNumBenchAlgs] = { "A*", "MM", "BOBA", "BOBA-f2f" };
+
+struct benchInstance {
+	std::string scenario; // scenario file the instance came from
+	int index; // position in that file
+	int bucket;
+	std::string mapFile;
+	xyLoc start, goal;
+	double optimal;
+};
+
+struct benchResult {
+	bool run;
+	double cost;
+	uint64_t expanded;
+	int64_t necessary; // -1 if the algorithm does not count them
+	double seconds;
+	uint64_t stored; // states in the open and closed lists at the end
+	int64_t bytes; // open/closed list memory, including capacity kept from earlier instances; -1 if unknown
+};
+
+/**
+ * Search objects of one worker thread. Their open/closed lists use
+ * EpochIndexTable by default, so reusing them for the next instance resets
+ * the lists in O(1) and keeps the memory they allocated.
+ */
+struct benchSearches {
+	TemplateAStar<xyLoc, tDirection, MapEnvironment> astar;
+	MM<xyLoc, tDirection, MapEnvironment> mm;
+	BOBA<xyLoc, tDirection, MapEnvironment> boba;
+	BOBA<xyLoc, tDirection, MapEnvironment> bobaF2F;
+	benchSearches() { bobaF2F.SetFrontToFront(true); }
+};
+
+// map, heuristic and searches owned by one worker thread
+struct threadEnvironment {
+	std::string mapFile;
+	std::unique_ptr<Map> map;
+	std::unique_ptr<MapEnvironment> env;
+	std::unique_ptr<WeightedHeuristic<xyLoc>> h;
+	std::unique_ptr<benchSearches> searches;
+	double loadSeconds = 0; // time spent loading maps
+};
+
+bool EndsWith(const std::string &s, const char *suffix);
+std::string BaseName(const std::string &path);
+bool ListFiles(const std::string &dir, const char *suffix, std::vector<std::string> &files);
+bool LoadInstances(const std::string &mapDir, const std::string &scenDir, std::vector<benchInstance> &instances);
+void Solve(const benchInstance &inst, threadEnvironment &te, double weight, bool mapCache, bool reuse, const bool *algs, benchResult *results);
+void WriteCSV(const char *file, const std::vector<benchInstance> &instances, const std::vector<benchResult> &results);
+void WriteJSON(const char *file, const std::vector<benchInstance> &instances, const std::vector<benchResult> &results);
+double PeakMemoryMB();
+template <class timed>
+double TimeSeconds(timed f);
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		printf("Usage: %s <map dir> <scenario dir> [-threads n] [-alg astar|mm|boba|boba-f2f]... [-weight w] [-limit n] [-cache 0|1] [-reuse 0|1] [-csv file] [-json file]\n", argv[0]);
+		printf("Solves every instance of every .scen file in <scenario dir>; maps are found by file name in <map dir>.\n");
+		printf("-limit n only uses the first n instances of each scenario file.\n");
+		printf("-cache 1 loads maps through a passability bitmap cached next to each map file.\n");
+		printf("-reuse 0 creates new searches for every instance instead of reusing each thread's searches.\n");
+		return 1;
+	}
+	std::string mapDir = argv[1];
+	std::string scenDir = argv[2];
+	int threads = std::max(1u, std::thread::hardware_concurrency());
+	bool algs[kNumBenchAlgs] = { false, false, false, false };
+	bool anyAlg = false;
+	double weight = 1.0;
+	int limit = 0;
+	bool mapCache = false;
+	bool reuse = true;
+	const char *csvFile = 0;
+	const char *jsonFile = 0;
+	for (int x = 3; x+1 < argc; x += 2)
+	{
+		if (strcmp(argv[x], "-threads") == 0)
+			threads = std::max(1, atoi(argv[x+1]));
+		else if (strcmp(argv[x], "-alg") == 0)
+		{
+			if (strcmp(argv[x+1], "astar") == 0)
+				algs[kBenchAStar] = true;
+			else if (strcmp(argv[x+1], "mm") == 0)
+				algs[kBenchMM] = true;
+			else if (strcmp(argv[x+1], "boba") == 0)
+				algs[kBenchBOBA] = true;
+			else if (strcmp(argv[x+1], "boba-f2f") == 0)
+				algs[kBenchBOBAF2F] = true;
+			else {
+				printf("Unknown algorithm '%s'\n", argv[x+1]);
+				return 1;
+			}
+			anyAlg = true;
+		}
+		else if (strcmp(argv[x], "-weight") == 0)
+			weight = atof(argv[x+1]);
+		else if (strcmp(argv[x], "-limit") == 0)
+			limit = atoi(argv[x+1]);
+		else if (strcmp(argv[x], "-cache") == 0)
+			mapCache = (atoi(argv[x+1]) != 0);
+		else if (strcmp(argv[x], "-reuse") == 0)
+			reuse = (atoi(argv[x+1]) != 0);
+		else if (strcmp(argv[x], "-csv") == 0)
+			csvFile = argv[x+1];
+		else if (strcmp(argv[x], "-json") == 0)
+			jsonFile = argv[x+1];
+		else {
+			printf("Unknown option '%s'\n", argv[x]);
+			return 1;
+		}
+	}
+	if (!anyAlg)
+		algs[kBenchAStar] = algs[kBenchMM] = algs[kBenchBOBA] = true;
+
+	std::vector<benchInstance> all, instances;
+	double scenarioSeconds = TimeSeconds([&]{ LoadInstances(mapDir, scenDir, all); });
+	if (all.size() == 0)
+		return 1;
+	int unsolvable = 0;
+	for (const auto &i : all)
+	{
+		if (limit != 0 && i.index >= limit)
+			continue;
+		// some scenario files mark unreachable goals with a cost of 0
+		if (i.optimal <= 0 && !(i.start == i.goal))
+		{
+			unsolvable++;
+			continue;
+		}
+		instances.push_back(i);
+	}
+	if (unsolvable > 0)
+		printf("Skipping %d instances without a solution\n", unsolvable);
+	// instances on the same map next to each other, so that threads rarely reload maps
+	std::stable_sort(instances.begin(), instances.end(),
+					 [](const benchInstance &a, const benchInstance &b) { return a.mapFile < b.mapFile; });
+	printf("%d instances, %d threads\n", (int)instances.size(), threads);
+
+	std::vector<benchResult> results(instances.size()*kNumBenchAlgs);
+	std::vector<threadEnvironment> environments(threads);
+	WorkerPool pool(threads);
+
+	auto startTime = std::chrono::steady_clock::now();
+	pool.ParallelFor(instances.size(), [&](size_t which, int thread) {
+		Solve(instances[which], environments[thread], weight, mapCache, reuse, algs, &results[which*kNumBenchAlgs]);
+	});
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+	double mapSeconds = 0;
+	for (const auto &te : environments)
+		mapSeconds += te.loadSeconds;
+	printf("Loading: %1.3fs scenarios, %1.3fs maps (all threads)\n", scenarioSeconds, mapSeconds);
+
+	// scenario files store costs to about six significant digits
+	int errors = 0;
+	for (size_t x = 0; x < instances.size(); x++)
+		for (int a = 0; a < kNumBenchAlgs; a++)
+			if (results[x*kNumBenchAlgs+a].run &&
+				fabs(results[x*kNumBenchAlgs+a].cost-instances[x].optimal) > 1e-4*std::max(1.0, instances[x].optimal))
+			{
+				printf("Error: %s found cost %f on %s #%d, expected %f\n", algNames[a], results[x*kNumBenchAlgs+a].cost,
+					   instances[x].scenario.c_str(), instances[x].index, instances[x].optimal);
+				errors++;
+			}
+	for (int a = 0; a < kNumBenchAlgs; a++)
+	{
+		if (!algs[a])
+			continue;
+		uint64_t expanded = 0;
+		double seconds = 0;
+		for (size_t x = 0; x < instances.size(); x++)
+		{
+			expanded += results[x*kNumBenchAlgs+a].expanded;
+			seconds += results[x*kNumBenchAlgs+a].seconds;
+		}
+		printf("%s: %llu nodes expanded, %1.2fs search time\n", algNames[a], (unsigned long long)expanded, seconds);
+	}
+	printf("%1.2fs elapsed, %1.1f instances/s, %1.1fMB peak memory\n", elapsed,
+		   (elapsed > 0)?(instances.size()/elapsed):0, PeakMemoryMB());
+
+	if (csvFile)
+		WriteCSV(csvFile, instances, results);
+	if (jsonFile)
+		WriteJSON(jsonFile, instances, results);
+	return (errors == 0)?0:1;
+}
+
+bool EndsWith(const std::string &s, const char *suffix)
+{
+	size_t len = strlen(suffix);
+	return s.size() >= len && s.compare(s.size()-len, len, suffix) == 0;
+}
+
+std::string BaseName(const std::string &path)
+{
+	size_t slash = path.find_last_of('/');
+	return (slash == std::string::npos)?path:path.substr(slash+1);
+}
+
+/**
+ * Put the names of the files in dir that end with suffix into files, sorted.
+ */
+bool ListFiles(const std::string &dir, const char *suffix, std::vector<std::string> &files)
+{
+	DIR *d = opendir(dir.c_str());
+	if (d == 0)
+	{
+		printf("Cannot open directory %s\n", dir.c_str());
+		return false;
+	}
+	while (struct dirent *entry = readdir(d))
+	{
+		std::string name = entry->d_name;
+		if (EndsWith(name, suffix))
+			files.push_back(dir+"/"+name);
+	}
+	closedir(d);
+	std::sort(files.begin(), files.end());
+	return true;
+}
+
+bool LoadInstances(const std::string &mapDir, const std::string &scenDir, std::vector<benchInstance> &instances)
+{
+	std::vector<std::string> scenarios;
+	if (!ListFiles(scenDir, ".scen", scenarios))
+		return false;
+	for (const auto &file : scenarios)
+	{
+		ScenarioLoader loader(file.c_str());
+		for (int x = 0; x < loader.GetNumExperiments(); x++)
+		{
+			Experiment e = loader.GetNthExperiment(x);
+			benchInstance i;
+			i.scenario = BaseName(file);
+			i.index = x;
+			i.bucket = e.GetBucket();
+			i.mapFile = mapDir+"/"+BaseName(e.GetMapName());
+			i.start.x = e.GetStartX();
+			i.start.y = e.GetStartY();
+			i.goal.x = e.GetGoalX();
+			i.goal.y = e.GetGoalY();
+			i.optimal = e.GetDistance();
+			instances.push_back(i);
+		}
+	}
+	if (instances.size() == 0)
+	{
+		printf("No scenarios found in %s\n", scenDir.c_str());
+		return false;
+	}
+	return true;
+}
+
+template <class timed>
+double TimeSeconds(timed f)
+{
+	auto startTime = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+}
+
+/**
+ * Solve one instance with every selected algorithm, loading the map into
+ * the thread's environment first if the thread was working on another map.
+ */
+void Solve(const benchInstance &inst, threadEnvironment &te, double weight, bool mapCache, bool reuse, const bool *algs, benchResult *results)
+{
+	if (te.mapFile != inst.mapFile)
+	{
+		te.h.reset();
+		te.env.reset();
+		te.loadSeconds += TimeSeconds([&]{ te.map.reset(new Map(inst.mapFile.c_str(), mapCache)); });
+		te.env.reset(new MapEnvironment(te.map.get()));
+		te.env->SetDiagonalCost(SQUARE_ROOT_OF2);
+		te.h.reset(new WeightedHeuristic<xyLoc>(te.env.get(), weight));
+		te.mapFile = inst.mapFile;
+	}
+	if (!reuse || !te.searches)
+		te.searches.reset(new benchSearches);
+	MapEnvironment *me = te.env.get();
+	WeightedHeuristic<xyLoc> *wh = te.h.get();
+	benchSearches &bs = *te.searches;
+	std::vector<xyLoc> path;
+
+	for (int a = 0; a < kNumBenchAlgs; a++)
+	{
+		results[a].run = algs[a];
+		results[a].necessary = -1;
+		results[a].bytes = -1;
+	}
+	if (algs[kBenchAStar])
+	{
+		auto &astar = bs.astar;
+		astar.SetHeuristic(wh);
+		results[kBenchAStar].seconds = TimeSeconds([&]{ astar.GetPath(me, inst.start, inst.goal, path); });
+		results[kBenchAStar].cost = me->GetPathLength(path);
+		results[kBenchAStar].expanded = astar.GetNodesExpanded();
+		results[kBenchAStar].stored = astar.GetNumItems();
+	}
+	if (algs[kBenchMM])
+	{
+		auto &mm = bs.mm;
+		results[kBenchMM].seconds = TimeSeconds([&]{ mm.GetPath(me, inst.start, inst.goal, wh, wh, path); });
+		results[kBenchMM].cost = me->GetPathLength(path);
+		results[kBenchMM].expanded = mm.GetNodesExpanded();
+		results[kBenchMM].stored = mm.GetNumForwardItems()+mm.GetNumBackwardItems();
+	}
+	if (algs[kBenchBOBA])
+	{
+		auto &boba = bs.boba;
+		results[kBenchBOBA].seconds = TimeSeconds([&]{ boba.GetPath(me, inst.start, inst.goal, wh, wh, path); });
+		results[kBenchBOBA].cost = me->GetPathLength(path);
+		results[kBenchBOBA].expanded = boba.GetNodesExpanded();
+		results[kBenchBOBA].necessary = boba.GetNecessaryExpansions();
+		results[kBenchBOBA].stored = boba.GetNumForwardItems()+boba.GetNumBackwardItems();
+		results[kBenchBOBA].bytes = boba.GetMemoryUsage();
+	}
+	if (algs[kBenchBOBAF2F])
+	{
+		auto &boba = bs.bobaF2F;
+		results[kBenchBOBAF2F].seconds = TimeSeconds([&]{ boba.GetPath(me, inst.start, inst.goal, wh, wh, path); });
+		results[kBenchBOBAF2F].cost = me->GetPathLength(path);
+		results[kBenchBOBAF2F].expanded = boba.GetNodesExpanded();
+		results[kBenchBOBAF2F].necessary = boba.GetNecessaryExpansions();
+		results[kBenchBOBAF2F].stored = boba.GetNumForwardItems()+boba.GetNumBackwardItems();
+		results[kBenchBOBAF2F].bytes = boba.GetMemoryUsage();
+	}
+}
+
+void WriteCSV(const char *file, const std::vector<benchInstance> &instances, const std::vector<benchResult> &results)
+{
+	FILE *f = fopen(file, "w");
+	if (f == 0)
+	{
+		printf("Cannot write %s\n", file);
+		return;
+	}
+	fprintf(f, "scenario,index,bucket,map,alg,optimal,cost,expanded,necessary,seconds,stored,bytes\n");
+	for (size_t x = 0; x < instances.size(); x++)
+	{
+		for (int a = 0; a < kNumBenchAlgs; a++)
+		{
+			const benchResult &r = results[x*kNumBenchAlgs+a];
+			if (!r.run)
+				continue;
+			fprintf(f, "%s,%d,%d,%s,%s,%f,%f,%llu,%lld,%f,%llu,%lld\n", instances[x].scenario.c_str(), instances[x].index,
+					instances[x].bucket, BaseName(instances[x].mapFile).c_str(), algNames[a], instances[x].optimal, r.cost,
+					(unsigned long long)r.expanded, (long long)r.necessary, r.seconds, (unsigned long long)r.stored, (long long)r.bytes);
+		}
+	}
+	fclose(f);
+}
+
+void WriteJSON(const char *file, const std::vector<benchInstance> &instances, const std::vector<benchResult> &results)
+{
+	FILE *f = fopen(file, "w");
+	if (f == 0)
+	{
+		printf("Cannot write %s\n", file);
+		return;
+	}
+	fprintf(f, "[\n");
+	bool first = true;
+	for (size_t x = 0; x < instances.size(); x++)
+	{
+		for (int a = 0; a < kNumBenchAlgs; a++)
+		{
+			const benchResult &r = results[x*kNumBenchAlgs+a];
+			if (!r.run)
+				continue;
+			fprintf(f, "%s  {\"scenario\": \"%s\", \"index\": %d, \"bucket\": %d, \"map\": \"%s\", \"alg\": \"%s\", "
+					"\"optimal\": %f, \"cost\": %f, \"expanded\": %llu, \"necessary\": %lld, \"seconds\": %f, "
+					"\"stored\": %llu, \"bytes\": %lld}", first?"":",\n", instances[x].scenario.c_str(), instances[x].index,
+					instances[x].bucket, BaseName(instances[x].mapFile).c_str(), algNames[a], instances[x].optimal, r.cost,
+					(unsigned long long)r.expanded, (long long)r.necessary, r.seconds, (unsigned long long)r.stored, (long long)r.bytes);
+			first = false;
+		}
+	}
+	fprintf(f, "\n]\n");
+	fclose(f);
+}
+
+/**
+ * Peak resident set size of the whole process. Threads share it, so it is
+ * reported for the batch rather than per instance.
+ */
+double PeakMemoryMB()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef OS_MAC
+	return usage.ru_maxrss/1048576.0; // bytes
+#else
+	return usage.ru_maxrss/1024.0; // kilobytes
+#endif
+}
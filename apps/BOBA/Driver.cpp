@@ -26,6 +26,8 @@
 #include "TemplateAStar.h"
 #include "MM.h"
 #include "BOBA.h"
+#include "BDOpenClosedSoA.h"
+#include "BDBucketOpenClosed.h"
 //#include "WeightedHeuristic.h"
 
 #define SQUARE_ROOT_OF2 1.414213562373
@@ -39,7 +41,13 @@ enum AlgType
 	kBOBA0 =2,
 	kMM = 3,
 	kMM0 = 4,
-	kIDAStar = 5
+	kIDAStar = 5,
+	kBOBASoA = 6, // BOBA with structure-of-arrays node storage
+	kBOBABucket = 7, // BOBA with integer-cost bucket queues
+	kBOBAConcurrent = 8, // BOBA expanding both directions of a pair at once
+	kBOBANoParent = 9, // BOBA without parent pointers, paths rebuilt from g-costs
+	kBOBAInlined = 10, // BOBA with an inlined heuristic and exact integer costs, timed against kBOBA
+	kBOBAFrontToFront = 11 // BOBA that also prunes with front-to-front heuristic bounds
 };
 
 namespace GRIDMAPTEST {
@@ -92,6 +100,32 @@ namespace PANCAKETEST {
 	
 	template<int N>
 	void pancakeTest(instanceType type, AlgType alg);
+	// byte budget for BOBA's open/closed lists; 0 for no limit
+	size_t memoryLimit = 0;
+	// BOBA stops once its incumbent is this close to the lower bound
+	double gapTolerance = 0;
+
+	// The gap heuristic of PancakePuzzle::HCost, but without a virtual call
+	// or a shared goal-location table, so that BOBA can inline it.
+	template <int N>
+	struct GapHeuristic {
+		double HCost(const PancakePuzzleState<N> &s, const PancakePuzzleState<N> &goal) const
+		{
+			int goalLocs[N];
+			for (int x = 0; x < N; x++)
+				goalLocs[goal.puzzle[x]] = x;
+			int h = 0;
+			for (int x = 0; x < N-1; x++)
+			{
+				int diff = goalLocs[s.puzzle[x]]-goalLocs[s.puzzle[x+1]];
+				if (diff > 1 || diff < -1)
+					h++;
+			}
+			if (goalLocs[s.puzzle[N-1]] != N-1)
+				h++;
+			return h;
+		}
+	};
 }
 
 namespace RUBIKSTEST {
@@ -106,18 +140,59 @@ namespace RUBIKSTEST {
 		k8210
 	};
 	const char *hprefix;
+	// threads BOBA uses to evaluate successor heuristics
+	int numThreads = 1;
 
 	Heuristic<RubiksState> forward;
 	Heuristic<RubiksState> reverse;
 
+	// loads or builds each PDB and adds the max over them to result
+	void BuildMaxPDB(RubiksState goal, Heuristic<RubiksState> &result, const std::vector<RubikPDB *> &pdbs);
 	void BuildHeuristics(RubiksState start, RubiksState goal, Heuristic<RubiksState> &result, heuristicType h);
 
 	void solver(RubiksState &start, RubiksState &goal, AlgType alg);
 	void rubiksTest(heuristicType h, AlgType alg, const char *heuristicloc, int count=25);
 }
 
+namespace INDEXTABLETEST {
+	// BDOpenClosed with the original hash_map index and with the flat open-addressing one
+	template <class state>
+	using HashIndexQueue = BDOpenClosed<state, BOBACompareOpenReady<state>, BOBACompareOpenWaiting<state>, BDOpenClosedData<state>, BDHashMapIndex>;
+	template <class state>
+	using FlatIndexQueue = BDOpenClosed<state, BOBACompareOpenReady<state>, BOBACompareOpenWaiting<state>, BDOpenClosedData<state>, BDLinearProbeIndex>;
+
+	void gridTest(const char *mapFile, const char *scenFile, int teststart, int testend);
+	void pancakeTest(PANCAKETEST::instanceType type);
+}
+
+namespace CONCURRENTTEST {
+	// BOBA expanding both nodes of each pair at once must find the costs
+	// found by expanding them one after the other
+	void gridTest(const char *mapFile, const char *scenFile, int teststart, int testend);
+	void pancakeTest(int count);
+	const int LENGTH = 12;
+}
+
+namespace MEMORYLIMITTEST {
+	// serial BOBA that compacts its closed records must still find optimal costs
+	void gridTest(const char *mapFile, const char *scenFile, int teststart, int testend);
+	void pancakeTest(int count);
+	// small enough to compact many times on every instance
+	const size_t limit = 1<<16;
+}
+
 int main(int argc, char** argv)
 {
+	// "-trace <file>" in front of any test writes its expansions to file
+	const char *traceFile = 0;
+	if (argc > 2 && strcmp(argv[1], "-trace") == 0)
+	{
+		traceFile = argv[2];
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
+
 	if (argc > 2 && strcmp(argv[1], "-gridMapTest") == 0)
 	{
 		using namespace GRIDMAPTEST;
@@ -180,6 +255,10 @@ int main(int argc, char** argv)
 		int alg = 1;
 		if (argc > 3)
 			alg = std::atoi(argv[3]);
+		if (argc > 4)
+			memoryLimit = (size_t)std::atoi(argv[4])<<20;
+		if (argc > 5)
+			gapTolerance = std::atof(argv[5]);
 		pancakeTest<LENGTH>(type,(AlgType)alg);
 	}
 	else if (argc > 2 && strcmp(argv[1], "-rubiksTest") == 0)
@@ -207,8 +286,61 @@ int main(int argc, char** argv)
 		int count = 25;
 		if (argc > 5)
 			count = std::atoi(argv[5]);
+		if (argc > 6)
+			numThreads = std::atoi(argv[6]);
 		rubiksTest(type,(AlgType)alg,hpre,count);
 	}
+	else if (argc > 4 && strcmp(argv[1], "-indexTableTest") == 0 && strcmp(argv[2], "grid") == 0)
+	{
+		int start = 1;
+		int end = 1000000;
+		if (argc > 5)
+			start = std::atoi(argv[5]);
+		if (argc > 6)
+			end = std::atoi(argv[6]);
+		INDEXTABLETEST::gridTest(argv[3], argv[4], start, end);
+	}
+	else if (argc > 3 && strcmp(argv[1], "-indexTableTest") == 0 && strcmp(argv[2], "pancake") == 0)
+	{
+		PANCAKETEST::instanceType type = PANCAKETEST::s5;
+		if (strcmp(argv[3], "l9") == 0)
+			type = PANCAKETEST::l9;
+		INDEXTABLETEST::pancakeTest(type);
+	}
+	else if (argc > 4 && strcmp(argv[1], "-concurrentTest") == 0 && strcmp(argv[2], "grid") == 0)
+	{
+		int start = 1;
+		int end = 1000000;
+		if (argc > 5)
+			start = std::atoi(argv[5]);
+		if (argc > 6)
+			end = std::atoi(argv[6]);
+		CONCURRENTTEST::gridTest(argv[3], argv[4], start, end);
+	}
+	else if (argc > 2 && strcmp(argv[1], "-concurrentTest") == 0 && strcmp(argv[2], "pancake") == 0)
+	{
+		int count = 100;
+		if (argc > 3)
+			count = std::atoi(argv[3]);
+		CONCURRENTTEST::pancakeTest(count);
+	}
+	else if (argc > 4 && strcmp(argv[1], "-memoryLimitTest") == 0 && strcmp(argv[2], "grid") == 0)
+	{
+		int start = 1;
+		int end = 1000000;
+		if (argc > 5)
+			start = std::atoi(argv[5]);
+		if (argc > 6)
+			end = std::atoi(argv[6]);
+		MEMORYLIMITTEST::gridTest(argv[3], argv[4], start, end);
+	}
+	else if (argc > 2 && strcmp(argv[1], "-memoryLimitTest") == 0 && strcmp(argv[2], "pancake") == 0)
+	{
+		int count = 100;
+		if (argc > 3)
+			count = std::atoi(argv[3]);
+		MEMORYLIMITTEST::pancakeTest(count);
+	}
 
 	else
 	{
@@ -216,10 +348,28 @@ int main(int argc, char** argv)
 			<< "1: " << argv[0] << " -gridMapTest <filename> [weight] [teststart] [testend]\n"
 			<< "2: " << argv[0] << " -gridMapGUI\n"
 			<< "3: " << argv[0] << " -tohTest [alg] [first] [last]\n"
-			<< "4: " << argv[0] << " -pancakeTest <instanceType> [alg]\n"
-			<< "5: " << argv[0] << " -rubiksTest <hprefix> [alg] [heuristicType] [count]\n";
+			<< "4: " << argv[0] << " -pancakeTest <instanceType> [alg] [memory limit MB] [gap tolerance]\n"
+			<< "5: " << argv[0] << " -rubiksTest <hprefix> [alg] [heuristicType] [count] [threads]\n"
+			<< "6: " << argv[0] << " -indexTableTest grid <map file> <scenario file> [teststart] [testend]\n"
+			<< "7: " << argv[0] << " -indexTableTest pancake <instanceType>\n"
+			<< "8: " << argv[0] << " -concurrentTest grid <map file> <scenario file> [teststart] [testend]\n"
+			<< "9: " << argv[0] << " -concurrentTest pancake [count]\n"
+			<< "10: " << argv[0] << " -memoryLimitTest grid <map file> <scenario file> [teststart] [testend]\n"
+			<< "11: " << argv[0] << " -memoryLimitTest pancake [count]\n"
+			<< "Any test can be preceded by -trace <file> to record its expansions (build with TRACE=1).\n";
 	}
 
+	if (traceFile)
+	{
+#ifdef SEARCH_TRACE
+		if (SearchTrace::Dump(traceFile))
+			printf("%llu expansions traced to %s\n", (unsigned long long)SearchTrace::Size(), traceFile);
+		else
+			printf("Cannot write trace file %s\n", traceFile);
+#else
+		printf("Tracing is compiled out; rebuild with TRACE=1 to use -trace\n");
+#endif
+	}
 
 	return 0;
 }
@@ -231,49 +381,29 @@ int main(int argc, char** argv)
 bool GRIDMAPTEST::LoadBenchmark(std::vector<int>& group, std::vector<int>& startx, std::vector<int>& starty, std::vector<int>& goalx, std::vector<int>& goaly,
 	std::vector<double>& expectedCost, std::string fileName)
 {
-	std::ifstream fin;
-	fin.open(fileName);
-	if (!fin.is_open())
+	// ScenarioLoader memory-maps the file and parses it in one pass
+	ScenarioLoader loader(fileName.c_str());
+	if (loader.GetNumExperiments() == 0)
 	{
 		std::cout << "fail to load benchmark file: " << fileName << "\n";
 		return false;
 	}
 
+	group.resize(0);
 	startx.resize(0);
 	starty.resize(0);
 	goalx.resize(0);
 	goaly.resize(0);
 	expectedCost.resize(0);
-	std::string str;
-	int grp;
-	//get rid of "version 1"
-	fin >> str;
-	fin >> str;
-	while (!fin.eof())
+	for (int x = 0; x < loader.GetNumExperiments(); x++)
 	{
-		//first 4 should be "group", "mapname", "map width", "map height"
-		//which are not helpful for this assignment
-		fin >> str;
-		grp = std::stoi(str);
-		group.push_back(grp);
-
-		fin >> str;
-		fin >> str;
-		fin >> str;
-
-		if (fin.eof())
-			break;
-
-		fin >> str;
-		startx.push_back(std::stoi(str));
-		fin >> str;
-		starty.push_back(std::stoi(str));
-		fin >> str;
-		goalx.push_back(std::stoi(str));
-		fin >> str;
-		goaly.push_back(std::stoi(str));
-		fin >> str;
-		expectedCost.push_back(std::stod(str));
+		Experiment e = loader.GetNthExperiment(x);
+		group.push_back(e.GetBucket());
+		startx.push_back(e.GetStartX());
+		starty.push_back(e.GetStartY());
+		goalx.push_back(e.GetGoalX());
+		goaly.push_back(e.GetGoalY());
+		expectedCost.push_back(e.GetDistance());
 	}
 	return true;
 }
@@ -426,7 +556,7 @@ void TOHTEST::TestTOH(Heuristic<TOHState<N>> *f, AlgType alg, int first, int las
 			printf("%1.2f elapsed\n", timer.GetElapsedTime());
 		}
 
-		else if (alg == 1)
+		else if (alg == 1 || alg == kBOBABucket)
 		{
 			//we need to build the backward hueristic for BOBA
 			TOH<N - M> absToh2;
@@ -439,20 +569,28 @@ void TOHTEST::TestTOH(Heuristic<TOHState<N>> *f, AlgType alg, int first, int las
 			Heuristic<TOHState<N>> back;
 
 			back.lookups.resize(0);
-			back.lookups.push_back({ kAddNode, 1, 2 });
+			back.lookups.push_back({ kAddNode, 1, 1 });
 			back.lookups.push_back({ kLeafNode, 0, 0 });
 
 			back.heuristics.resize(0);
 			back.heuristics.push_back(&pdb2);
 
-			printf("-=-=-BOBA-=-=-\n");
+			printf("-=-=-BOBA%s-=-=-\n", (alg == kBOBABucket)?" (buckets)":"");
+			uint64_t expanded;
 			timer.StartTimer();
-
-			boba.InitializeSearch(&ts, s, g, f, &back, thePath);
-			boba.GetPath(&ts, s, g, f, &back, thePath);
-		
+			if (alg == kBOBABucket)
+			{
+				BOBA<TOHState<N>, TOHMove, TOH<N>, BDBucketOpenClosed<TOHState<N>>> bobaBucket;
+				bobaBucket.GetPath(&ts, s, g, f, &back, thePath);
+				expanded = bobaBucket.GetNodesExpanded();
+			}
+			else {
+				boba.InitializeSearch(&ts, s, g, f, &back, thePath);
+				boba.GetPath(&ts, s, g, f, &back, thePath);
+				expanded = boba.GetNodesExpanded();
+			}
 			timer.EndTimer();
-			printf("%llu nodes expanded\n", boba.GetNodesExpanded());
+			printf("%llu nodes expanded\n", (unsigned long long)expanded);
 			printf("Solution path length %1.0f\n", ts.GetPathLength(thePath));
 			printf("%1.2f elapsed\n", timer.GetElapsedTime());
 
@@ -485,7 +623,7 @@ void TOHTEST::TestTOH(Heuristic<TOHState<N>> *f, AlgType alg, int first, int las
 			Heuristic<TOHState<N>> back;
 
 			back.lookups.resize(0);
-			back.lookups.push_back({ kAddNode, 1, 2 });
+			back.lookups.push_back({ kAddNode, 1, 1 });
 			back.lookups.push_back({ kLeafNode, 0, 0 });
 
 			back.heuristics.resize(0);
@@ -544,7 +682,7 @@ void TOHTEST::TOHTest(AlgType alg, int first, int last)
 	Heuristic<TOHState<numDisks>> h;
 
 	h.lookups.resize(0);
-	h.lookups.push_back({ kAddNode, 1, 2 });
+	h.lookups.push_back({ kAddNode, 1, 1 });
 	h.lookups.push_back({ kLeafNode, 0, 0 });
 
 	h.heuristics.resize(0);
@@ -599,6 +737,8 @@ void PANCAKETEST::pancakeTest(instanceType type, AlgType alg)
 
 	TemplateAStar<PancakePuzzleState<N>, PancakePuzzleAction, PancakePuzzle<N>> astar;
 	BOBA<PancakePuzzleState<N>, PancakePuzzleAction, PancakePuzzle<N>> boba;
+	boba.SetMemoryLimit(memoryLimit);
+	boba.SetGapTolerance(gapTolerance);
 
 	std::vector<PancakePuzzleState<N>> thePath;
 
@@ -645,17 +785,165 @@ void PANCAKETEST::pancakeTest(instanceType type, AlgType alg)
 		printf("%llu neccesary nodes expanded\n", boba.GetNecessaryExpansions());
 		printf("Solution path length %1.0f\n", pck.GetPathLength(thePath));
 		printf("%1.2f elapsed\n", timer.GetElapsedTime());
+		if (gapTolerance != 0)
+			printf("Lower bound %1.0f\n", boba.GetLowerBound());
+		if (memoryLimit != 0)
+			printf("%llu compactions, %llu records dropped, %1.1fMB saved, %1.1fMB in use\n",
+				   (unsigned long long)boba.GetCompactions(), (unsigned long long)boba.GetNodesCompacted(),
+				   boba.GetMemorySaved()/1048576.0, boba.GetMemoryUsage()/1048576.0);
+	}
+	else if (alg == kBOBASoA)
+	{
+		BOBA<PancakePuzzleState<N>, PancakePuzzleAction, PancakePuzzle<N>,
+			BDOpenClosedSoA<PancakePuzzleState<N>, BOBACompareOpenReady<PancakePuzzleState<N>>, BOBACompareOpenWaiting<PancakePuzzleState<N>>>> bobaSoA;
+		printf("-=-=-BOBA (SoA)-=-=-\n");
+		timer.StartTimer();
+
+		bobaSoA.GetPath(&pck, start, goal, &pck, &pck, thePath);
+
+		timer.EndTimer();
+		printf("%llu nodes expanded\n", (unsigned long long)bobaSoA.GetNodesExpanded());
+		printf("%llu neccesary nodes expanded\n", (unsigned long long)bobaSoA.GetNecessaryExpansions());
+		printf("Solution path length %1.0f\n", pck.GetPathLength(thePath));
+		printf("%1.2f elapsed\n", timer.GetElapsedTime());
+	}
+	else if (alg == kBOBABucket)
+	{
+		BOBA<PancakePuzzleState<N>, PancakePuzzleAction, PancakePuzzle<N>, BDBucketOpenClosed<PancakePuzzleState<N>>> bobaBucket;
+		printf("-=-=-BOBA (buckets)-=-=-\n");
+		timer.StartTimer();
+
+		bobaBucket.GetPath(&pck, start, goal, &pck, &pck, thePath);
+
+		timer.EndTimer();
+		printf("%llu nodes expanded\n", (unsigned long long)bobaBucket.GetNodesExpanded());
+		printf("%llu neccesary nodes expanded\n", (unsigned long long)bobaBucket.GetNecessaryExpansions());
+		printf("Solution path length %1.0f\n", pck.GetPathLength(thePath));
+		printf("%1.2f elapsed\n", timer.GetElapsedTime());
+	}
+	else if (alg == kBOBAConcurrent)
+	{
+		printf("-=-=-BOBA (concurrent)-=-=-\n");
+		boba.SetConcurrentDirections(true);
+		timer.StartTimer();
+
+		boba.GetPath(&pck, start, goal, &pck, &pck, thePath);
+
+		timer.EndTimer();
+		printf("%llu nodes expanded\n", (unsigned long long)boba.GetNodesExpanded());
+		printf("%llu neccesary nodes expanded\n", (unsigned long long)boba.GetNecessaryExpansions());
+		printf("Solution path length %1.0f\n", pck.GetPathLength(thePath));
+		printf("%1.2f elapsed\n", timer.GetElapsedTime());
+		if (gapTolerance != 0)
+			printf("Lower bound %1.0f\n", boba.GetLowerBound());
+		if (memoryLimit != 0)
+			printf("%llu compactions, %llu records dropped, %1.1fMB saved, %1.1fMB in use\n",
+				   (unsigned long long)boba.GetCompactions(), (unsigned long long)boba.GetNodesCompacted(),
+				   boba.GetMemorySaved()/1048576.0, boba.GetMemoryUsage()/1048576.0);
+	}
+	else if (alg == kBOBANoParent)
+	{
+		BOBA<PancakePuzzleState<N>, PancakePuzzleAction, PancakePuzzle<N>,
+			BDOpenClosed<PancakePuzzleState<N>, BOBACompareOpenReady<PancakePuzzleState<N>>, BOBACompareOpenWaiting<PancakePuzzleState<N>>,
+			BDOpenClosedDataNoParent<PancakePuzzleState<N>>>> bobaNoParent;
+		bobaNoParent.SetMemoryLimit(memoryLimit);
+		printf("-=-=-BOBA (no parent pointers)-=-=-\n");
+		timer.StartTimer();
+
+		bobaNoParent.GetPath(&pck, start, goal, &pck, &pck, thePath);
+
+		timer.EndTimer();
+		printf("%llu nodes expanded\n", (unsigned long long)bobaNoParent.GetNodesExpanded());
+		printf("%llu neccesary nodes expanded\n", (unsigned long long)bobaNoParent.GetNecessaryExpansions());
+		printf("Solution path length %1.0f\n", pck.GetPathLength(thePath));
+		printf("%1.2f elapsed\n", timer.GetElapsedTime());
+		printf("%1.1fMB in use, %llu records dropped\n", bobaNoParent.GetMemoryUsage()/1048576.0, (unsigned long long)bobaNoParent.GetNodesCompacted());
+	}
+	else if (alg == kBOBAInlined)
+	{
+		typedef PancakePuzzleState<N> state;
+		BOBA<state, PancakePuzzleAction, PancakePuzzle<N>,
+			BDOpenClosed<state, BOBACompareOpenReady<state, BOBAIntegerCosts>, BOBACompareOpenWaiting<state, BOBAIntegerCosts>>,
+			GapHeuristic<N>, BOBAIntegerCosts> bobaInlined;
+		GapHeuristic<N> gap;
+		double times[2];
+		uint64_t expanded[2];
+		double lengths[2];
+
+		printf("-=-=-BOBA (virtual heuristic, tolerance compares)-=-=-\n");
+		timer.StartTimer();
+		boba.GetPath(&pck, start, goal, &pck, &pck, thePath);
+		times[0] = timer.EndTimer();
+		expanded[0] = boba.GetNodesExpanded();
+		lengths[0] = pck.GetPathLength(thePath);
+		printf("%llu nodes expanded\n", (unsigned long long)expanded[0]);
+		printf("Solution path length %1.0f\n", lengths[0]);
+		printf("%1.2f elapsed\n", times[0]);
+
+		printf("-=-=-BOBA (inlined heuristic, integer compares)-=-=-\n");
+		timer.StartTimer();
+		bobaInlined.GetPath(&pck, start, goal, &gap, &gap, thePath);
+		times[1] = timer.EndTimer();
+		expanded[1] = bobaInlined.GetNodesExpanded();
+		lengths[1] = pck.GetPathLength(thePath);
+		printf("%llu nodes expanded\n", (unsigned long long)expanded[1]);
+		printf("Solution path length %1.0f\n", lengths[1]);
+		printf("%1.2f elapsed\n", times[1]);
+
+		if (lengths[0] != lengths[1])
+			printf("Error: solution lengths differ\n");
+		printf("%1.2fx speedup\n", (times[1] > 0)?(times[0]/times[1]):0);
+	}
+	else if (alg == kBOBAFrontToFront)
+	{
+		printf("-=-=-BOBA (front-to-front)-=-=-\n");
+		boba.SetFrontToFront(true);
+		timer.StartTimer();
+
+		boba.GetPath(&pck, start, goal, &pck, &pck, thePath);
+
+		timer.EndTimer();
+		printf("%llu nodes expanded\n", (unsigned long long)boba.GetNodesExpanded());
+		printf("%llu neccesary nodes expanded\n", (unsigned long long)boba.GetNecessaryExpansions());
+		printf("Solution path length %1.0f\n", pck.GetPathLength(thePath));
+		printf("%1.2f elapsed\n", timer.GetElapsedTime());
+		printf("%llu nodes pruned by front-to-front bounds, %llu heuristic evaluations for them\n",
+			   (unsigned long long)boba.GetFrontToFrontPrunes(), (unsigned long long)boba.GetFrontToFrontEvaluations());
 	}
 
 
 }
 
 
+void RUBIKSTEST::BuildMaxPDB(RubiksState goal, Heuristic<RubiksState> &result, const std::vector<RubikPDB *> &pdbs)
+{
+	for (RubikPDB *pdb : pdbs)
+	{
+		if (!pdb->Load(hprefix))
+		{
+			pdb->BuildPDB(goal, std::thread::hardware_concurrency());
+			pdb->Save(hprefix);
+		}
+		else {
+			printf("Loaded previous heuristic\n");
+		}
+	}
+	// bounded lookups stop at the first child above the bound, so the PDBs
+	// are evaluated in the order given
+	result.lookups.push_back({ kMaxNode, 1, (unsigned int)pdbs.size() });
+	for (unsigned int x = 0; x < pdbs.size(); x++)
+	{
+		result.lookups.push_back({ kLeafNode, x, 0 });
+		result.heuristics.push_back(pdbs[x]);
+	}
+}
+
 void RUBIKSTEST::BuildHeuristics(RubiksState start, RubiksState goal, Heuristic<RubiksState> &result, heuristicType h)
 {
 	RubiksCube cube;
 	std::vector<int> blank;
 
+	// corner PDBs go first in each max: they most often exceed the bound alone
 	switch (h)
 	{
 	case kNone:
@@ -670,31 +958,10 @@ void RUBIKSTEST::BuildHeuristics(RubiksState start, RubiksState goal, Heuristic<
 		std::vector<int> edges1 = { 1, 3, 8, 9 }; // first 4
 		std::vector<int> edges2 = { 0, 2, 4, 5 }; // first 4
 		std::vector<int> corners = { 0, 1, 2, 3 }; // first 4
-		RubikPDB *pdb1 = new RubikPDB(&cube, goal, edges1, blank);
-		RubikPDB *pdb2 = new RubikPDB(&cube, goal, edges2, blank);
-		RubikPDB *pdb3 = new RubikPDB(&cube, goal, blank, corners);
-		if (!pdb1->Load(hprefix))
-		{
-			pdb1->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb1->Save(hprefix);
-		}
-		if (!pdb2->Load(hprefix))
-		{
-			pdb2->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb2->Save(hprefix);
-		}
-		if (!pdb3->Load(hprefix))
-		{
-			pdb3->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb3->Save(hprefix);
-		}
-		result.lookups.push_back({ kMaxNode, 1, 3 });
-		result.lookups.push_back({ kLeafNode, 0, 0 });
-		result.lookups.push_back({ kLeafNode, 1, 0 });
-		result.lookups.push_back({ kLeafNode, 2, 0 });
-		result.heuristics.push_back(pdb1);
-		result.heuristics.push_back(pdb2);
-		result.heuristics.push_back(pdb3);
+		BuildMaxPDB(goal, result, {
+			new RubikPDB(&cube, goal, blank, corners),
+			new RubikPDB(&cube, goal, edges1, blank),
+			new RubikPDB(&cube, goal, edges2, blank) });
 		break;
 	}
 	case kSmall:
@@ -704,57 +971,12 @@ void RUBIKSTEST::BuildHeuristics(RubiksState start, RubiksState goal, Heuristic<
 		std::vector<int> edges3 = { 7, 8, 9, 10, 11 };
 		std::vector<int> corners1 = { 0, 1, 2, 3, 4, 5 };
 		std::vector<int> corners2 = { 2, 3, 4, 5, 6, 7 };
-		RubikPDB *pdb1 = new RubikPDB(&cube, goal, edges1, blank);
-		RubikPDB *pdb2 = new RubikPDB(&cube, goal, edges2, blank);
-		RubikPDB *pdb3 = new RubikPDB(&cube, goal, edges3, blank);
-		RubikPDB *pdb4 = new RubikPDB(&cube, goal, blank, corners1);
-		RubikPDB *pdb5 = new RubikPDB(&cube, goal, blank, corners2);
-		if (!pdb1->Load(hprefix))
-		{
-			pdb1->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb1->Save(hprefix);
-		}
-		else 
-			printf("Loaded previous heuristic\n");
-		if (!pdb2->Load(hprefix))
-		{
-			pdb2->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb2->Save(hprefix);
-		}
-		else 
-			printf("Loaded previous heuristic\n");
-		if (!pdb3->Load(hprefix))
-		{
-			pdb3->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb3->Save(hprefix);
-		}
-		else 
-			printf("Loaded previous heuristic\n");
-		if (!pdb4->Load(hprefix))
-		{
-			pdb4->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb4->Save(hprefix);
-		}
-		else 
-			printf("Loaded previous heuristic\n");
-		if (!pdb5->Load(hprefix))
-		{
-			pdb5->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb5->Save(hprefix);
-		}
-		else 
-			printf("Loaded previous heuristic\n");
-		result.lookups.push_back({ kMaxNode, 1, 5 });
-		result.lookups.push_back({ kLeafNode, 0, 0 });
-		result.lookups.push_back({ kLeafNode, 1, 0 });
-		result.lookups.push_back({ kLeafNode, 2, 0 });
-		result.lookups.push_back({ kLeafNode, 3, 0 });
-		result.lookups.push_back({ kLeafNode, 4, 0 });
-		result.heuristics.push_back(pdb1);
-		result.heuristics.push_back(pdb2);
-		result.heuristics.push_back(pdb3);
-		result.heuristics.push_back(pdb4);
-		result.heuristics.push_back(pdb5);
+		BuildMaxPDB(goal, result, {
+			new RubikPDB(&cube, goal, blank, corners1),
+			new RubikPDB(&cube, goal, blank, corners2),
+			new RubikPDB(&cube, goal, edges1, blank),
+			new RubikPDB(&cube, goal, edges2, blank),
+			new RubikPDB(&cube, goal, edges3, blank) });
 		break;
 	}
 	case k1997:
@@ -762,41 +984,10 @@ void RUBIKSTEST::BuildHeuristics(RubiksState start, RubiksState goal, Heuristic<
 		std::vector<int> edges1 = { 1, 3, 8, 9, 10, 11 };
 		std::vector<int> edges2 = { 0, 2, 4, 5, 6, 7 };
 		std::vector<int> corners = { 0, 1, 2, 3, 4, 5, 6, 7 };
-		RubikPDB *pdb1 = new RubikPDB(&cube, goal, edges1, blank);
-		RubikPDB *pdb2 = new RubikPDB(&cube, goal, edges2, blank);
-		RubikPDB *pdb3 = new RubikPDB(&cube, goal, blank, corners);
-
-		if (!pdb1->Load(hprefix))
-		{
-			pdb1->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb1->Save(hprefix);
-		}
-		else {
-			printf("Loaded previous heuristic\n");
-		}
-		if (!pdb2->Load(hprefix))
-		{
-			pdb2->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb2->Save(hprefix);
-		}
-		else {
-			printf("Loaded previous heuristic\n");
-		}
-		if (!pdb3->Load(hprefix))
-		{
-			pdb3->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb3->Save(hprefix);
-		}
-		else {
-			printf("Loaded previous heuristic\n");
-		}
-		result.lookups.push_back({ kMaxNode, 1, 3 });
-		result.lookups.push_back({ kLeafNode, 0, 0 });
-		result.lookups.push_back({ kLeafNode, 1, 0 });
-		result.lookups.push_back({ kLeafNode, 2, 0 });
-		result.heuristics.push_back(pdb1);
-		result.heuristics.push_back(pdb2);
-		result.heuristics.push_back(pdb3);
+		BuildMaxPDB(goal, result, {
+			new RubikPDB(&cube, goal, blank, corners),
+			new RubikPDB(&cube, goal, edges1, blank),
+			new RubikPDB(&cube, goal, edges2, blank) });
 		break;
 	}
 	case k888:
@@ -804,31 +995,10 @@ void RUBIKSTEST::BuildHeuristics(RubiksState start, RubiksState goal, Heuristic<
 		std::vector<int> edges1 = { 0, 1, 2, 3, 4, 5, 6, 7 };
 		std::vector<int> edges2 = { 1, 3, 5, 7, 8, 9, 10, 11 };
 		std::vector<int> corners = { 0, 1, 2, 3, 4, 5, 6, 7 }; // first 4
-		RubikPDB *pdb1 = new RubikPDB(&cube, goal, edges1, blank);
-		RubikPDB *pdb2 = new RubikPDB(&cube, goal, edges2, blank);
-		RubikPDB *pdb3 = new RubikPDB(&cube, goal, blank, corners);
-		if (!pdb1->Load(hprefix))
-		{
-			pdb1->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb1->Save(hprefix);
-		}
-		if (!pdb2->Load(hprefix))
-		{
-			pdb2->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb2->Save(hprefix);
-		}
-		if (!pdb3->Load(hprefix))
-		{
-			pdb3->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb3->Save(hprefix);
-		}
-		result.lookups.push_back({ kMaxNode, 1, 3 });
-		result.lookups.push_back({ kLeafNode, 0, 0 });
-		result.lookups.push_back({ kLeafNode, 1, 0 });
-		result.lookups.push_back({ kLeafNode, 2, 0 });
-		result.heuristics.push_back(pdb1);
-		result.heuristics.push_back(pdb2);
-		result.heuristics.push_back(pdb3);
+		BuildMaxPDB(goal, result, {
+			new RubikPDB(&cube, goal, blank, corners),
+			new RubikPDB(&cube, goal, edges1, blank),
+			new RubikPDB(&cube, goal, edges2, blank) });
 		break;
 	}
 	case k839:
@@ -836,31 +1006,10 @@ void RUBIKSTEST::BuildHeuristics(RubiksState start, RubiksState goal, Heuristic<
 		std::vector<int> edges1 = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
 		std::vector<int> edges2 = { 9, 10, 11 };
 		std::vector<int> corners = { 0, 1, 2, 3, 4, 5, 6, 7 };
-		RubikPDB *pdb1 = new RubikPDB(&cube, goal, edges1, blank);
-		RubikPDB *pdb2 = new RubikPDB(&cube, goal, edges2, blank);
-		RubikPDB *pdb3 = new RubikPDB(&cube, goal, blank, corners);
-		if (!pdb1->Load(hprefix))
-		{
-			pdb1->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb1->Save(hprefix);
-		}
-		if (!pdb2->Load(hprefix))
-		{
-			pdb2->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb2->Save(hprefix);
-		}
-		if (!pdb3->Load(hprefix))
-		{
-			pdb3->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb3->Save(hprefix);
-		}
-		result.lookups.push_back({ kMaxNode, 1, 3 });
-		result.lookups.push_back({ kLeafNode, 0, 0 });
-		result.lookups.push_back({ kLeafNode, 1, 0 });
-		result.lookups.push_back({ kLeafNode, 2, 0 });
-		result.heuristics.push_back(pdb1);
-		result.heuristics.push_back(pdb2);
-		result.heuristics.push_back(pdb3);
+		BuildMaxPDB(goal, result, {
+			new RubikPDB(&cube, goal, blank, corners),
+			new RubikPDB(&cube, goal, edges1, blank),
+			new RubikPDB(&cube, goal, edges2, blank) });
 		break;
 	}
 	case k8210:
@@ -868,31 +1017,10 @@ void RUBIKSTEST::BuildHeuristics(RubiksState start, RubiksState goal, Heuristic<
 		std::vector<int> edges1 = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
 		std::vector<int> edges2 = { 10, 11 };
 		std::vector<int> corners = { 0, 1, 2, 3, 4, 5, 6, 7 };
-		RubikPDB *pdb1 = new RubikPDB(&cube, goal, edges1, blank);
-		RubikPDB *pdb2 = new RubikPDB(&cube, goal, edges2, blank);
-		RubikPDB *pdb3 = new RubikPDB(&cube, goal, blank, corners);
-		if (!pdb1->Load(hprefix))
-		{
-			pdb1->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb1->Save(hprefix);
-		}
-		if (!pdb2->Load(hprefix))
-		{
-			pdb2->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb2->Save(hprefix);
-		}
-		if (!pdb3->Load(hprefix))
-		{
-			pdb3->BuildPDB(goal, std::thread::hardware_concurrency());
-			pdb3->Save(hprefix);
-		}
-		result.lookups.push_back({ kMaxNode, 1, 3 });
-		result.lookups.push_back({ kLeafNode, 0, 0 });
-		result.lookups.push_back({ kLeafNode, 1, 0 });
-		result.lookups.push_back({ kLeafNode, 2, 0 });
-		result.heuristics.push_back(pdb1);
-		result.heuristics.push_back(pdb2);
-		result.heuristics.push_back(pdb3);
+		BuildMaxPDB(goal, result, {
+			new RubikPDB(&cube, goal, blank, corners),
+			new RubikPDB(&cube, goal, edges1, blank),
+			new RubikPDB(&cube, goal, edges2, blank) });
 		break;
 	}
 	}
@@ -933,9 +1061,9 @@ void RUBIKSTEST::solver(RubiksState &start, RubiksState &goal,  AlgType alg)
 	}
 	
 
-	else if (alg == 1)//BOBA*
+	else if (alg == 1 || alg == kBOBASoA || alg == kBOBABucket || alg == kBOBAConcurrent)//BOBA*
 	{
-		printf("---BOBA*---\n");
+		printf("---BOBA*%s---\n", (alg == kBOBASoA)?" (SoA)":((alg == kBOBABucket)?" (buckets)":((alg == kBOBAConcurrent)?" (concurrent)":"")));
 		Timer t;
 
 		t.StartTimer();
@@ -950,14 +1078,38 @@ void RUBIKSTEST::solver(RubiksState &start, RubiksState &goal,  AlgType alg)
 
 		std::vector<RubiksState> thePath;
 
+		uint64_t expanded, necessary;
 		t.StartTimer();
-		BOBA<RubiksState, RubiksAction, RubiksCube> boba;
-		boba.InitializeSearch(&cube, start, goal, &forward, &reverse, thePath);
-		boba.GetPath(&cube, start, goal, &forward, &reverse, thePath);
+		if (alg == kBOBASoA)
+		{
+			BOBA<RubiksState, RubiksAction, RubiksCube,
+				BDOpenClosedSoA<RubiksState, BOBACompareOpenReady<RubiksState>, BOBACompareOpenWaiting<RubiksState>>> boba;
+			boba.SetNumThreads(numThreads);
+			boba.GetPath(&cube, start, goal, &forward, &reverse, thePath);
+			expanded = boba.GetNodesExpanded();
+			necessary = boba.GetNecessaryExpansions();
+		}
+		else if (alg == kBOBABucket)
+		{
+			BOBA<RubiksState, RubiksAction, RubiksCube, BDBucketOpenClosed<RubiksState>> boba;
+			boba.SetNumThreads(numThreads);
+			boba.GetPath(&cube, start, goal, &forward, &reverse, thePath);
+			expanded = boba.GetNodesExpanded();
+			necessary = boba.GetNecessaryExpansions();
+		}
+		else {
+			BOBA<RubiksState, RubiksAction, RubiksCube> boba;
+			boba.SetNumThreads(numThreads);
+			boba.SetConcurrentDirections(alg == kBOBAConcurrent);
+			boba.InitializeSearch(&cube, start, goal, &forward, &reverse, thePath);
+			boba.GetPath(&cube, start, goal, &forward, &reverse, thePath);
+			expanded = boba.GetNodesExpanded();
+			necessary = boba.GetNecessaryExpansions();
+		}
 
 		t.EndTimer();
-		printf("%llu nodes expanded\n", boba.GetNodesExpanded());
-		printf("%llu neccesary nodes expanded\n", boba.GetNecessaryExpansions());
+		printf("%llu nodes expanded\n", (unsigned long long)expanded);
+		printf("%llu neccesary nodes expanded\n", (unsigned long long)necessary);
 		printf("Solution path length %1.0f\n", cube.GetPathLength(thePath));
 		printf("%1.2f elapsed\n", t.GetElapsedTime());
 	}
@@ -995,4 +1147,228 @@ void RUBIKSTEST::rubiksTest(heuristicType h, AlgType alg, const char *heuristicl
 	
 		solver(s, g, alg);
 	}
-}
\ No newline at end of file
+}
+
+void INDEXTABLETEST::gridTest(const char *mapFile, const char *scenFile, int teststart, int testend)
+{
+	Map *m = new Map(mapFile);
+	MapEnvironment *env = new MapEnvironment(m);
+	env->SetDiagonalCost(SQUARE_ROOT_OF2);
+
+	std::vector<int> group, startx, starty, goalx, goaly;
+	std::vector<double> expectedCost;
+	if (!GRIDMAPTEST::LoadBenchmark(group, startx, starty, goalx, goaly, expectedCost, scenFile))
+		return;
+
+	BOBA<xyLoc, tDirection, MapEnvironment, HashIndexQueue<xyLoc>> hashBoba;
+	BOBA<xyLoc, tDirection, MapEnvironment, FlatIndexQueue<xyLoc>> flatBoba;
+	std::vector<xyLoc> path;
+	xyLoc from, to;
+	Timer t;
+	double hashTime = 0, flatTime = 0;
+	uint64_t expanded = 0;
+	int instances = 0;
+
+	for (int i = teststart - 1; i < std::min(testend, (int)(startx.size())); i++)
+	{
+		from.x = startx[i];
+		from.y = starty[i];
+		to.x = goalx[i];
+		to.y = goaly[i];
+
+		t.StartTimer();
+		hashBoba.GetPath(env, from, to, env, env, path);
+		hashTime += t.EndTimer();
+
+		t.StartTimer();
+		flatBoba.GetPath(env, from, to, env, env, path);
+		flatTime += t.EndTimer();
+
+		if (hashBoba.GetNodesExpanded() != flatBoba.GetNodesExpanded() ||
+			!fequal(hashBoba.GetSolutionCost(), flatBoba.GetSolutionCost()))
+		{
+			printf("Instance %d: index tables disagree (%llu/%1.2f vs %llu/%1.2f)\n", i+1,
+				   (unsigned long long)hashBoba.GetNodesExpanded(), hashBoba.GetSolutionCost(),
+				   (unsigned long long)flatBoba.GetNodesExpanded(), flatBoba.GetSolutionCost());
+		}
+		expanded += hashBoba.GetNodesExpanded();
+		instances++;
+	}
+	printf("%d instances, %llu nodes expanded\n", instances, (unsigned long long)expanded);
+	printf("hash_map index: %1.3fs elapsed\n", hashTime);
+	printf("linear probe index: %1.3fs elapsed (%1.2fx)\n", flatTime, flatTime>0?hashTime/flatTime:0);
+	delete env;
+	delete m;
+}
+
+void INDEXTABLETEST::pancakeTest(PANCAKETEST::instanceType type)
+{
+	using namespace PANCAKETEST;
+	PancakePuzzle<LENGTH> pck;
+	PancakePuzzleState<LENGTH> start;
+	PancakePuzzleState<LENGTH> goal;
+	goal.Reset();
+	GetInstance(type, start);
+
+	BOBA<PancakePuzzleState<LENGTH>, PancakePuzzleAction, PancakePuzzle<LENGTH>, HashIndexQueue<PancakePuzzleState<LENGTH>>> hashBoba;
+	BOBA<PancakePuzzleState<LENGTH>, PancakePuzzleAction, PancakePuzzle<LENGTH>, FlatIndexQueue<PancakePuzzleState<LENGTH>>> flatBoba;
+	std::vector<PancakePuzzleState<LENGTH>> thePath;
+	Timer t;
+
+	std::cout << " start: " << start << "\n";
+	t.StartTimer();
+	hashBoba.GetPath(&pck, start, goal, &pck, &pck, thePath);
+	double hashTime = t.EndTimer();
+	printf("hash_map index: %llu nodes expanded; %1.3fs elapsed\n", (unsigned long long)hashBoba.GetNodesExpanded(), hashTime);
+
+	t.StartTimer();
+	flatBoba.GetPath(&pck, start, goal, &pck, &pck, thePath);
+	double flatTime = t.EndTimer();
+	printf("linear probe index: %llu nodes expanded; %1.3fs elapsed (%1.2fx)\n", (unsigned long long)flatBoba.GetNodesExpanded(), flatTime,
+		   flatTime>0?hashTime/flatTime:0);
+	printf("Solution path length %1.0f\n", pck.GetPathLength(thePath));
+}
+
+void CONCURRENTTEST::gridTest(const char *mapFile, const char *scenFile, int teststart, int testend)
+{
+	Map *m = new Map(mapFile);
+	MapEnvironment *env = new MapEnvironment(m);
+	env->SetDiagonalCost(SQUARE_ROOT_OF2);
+
+	std::vector<int> group, startx, starty, goalx, goaly;
+	std::vector<double> expectedCost;
+	if (!GRIDMAPTEST::LoadBenchmark(group, startx, starty, goalx, goaly, expectedCost, scenFile))
+		return;
+
+	BOBA<xyLoc, tDirection, MapEnvironment> serialBoba, concurrentBoba;
+	concurrentBoba.SetConcurrentDirections(true);
+	std::vector<xyLoc> path;
+	xyLoc from, to;
+	int instances = 0, failures = 0;
+
+	for (int i = teststart - 1; i < std::min(testend, (int)(startx.size())); i++)
+	{
+		from.x = startx[i];
+		from.y = starty[i];
+		to.x = goalx[i];
+		to.y = goaly[i];
+
+		serialBoba.GetPath(env, from, to, env, env, path);
+		double serialCost = env->GetPathLength(path);
+		concurrentBoba.GetPath(env, from, to, env, env, path);
+		double concurrentCost = env->GetPathLength(path);
+		if (!fequal(serialCost, concurrentCost) || !fequal(serialBoba.GetSolutionCost(), concurrentBoba.GetSolutionCost()))
+		{
+			printf("Instance %d: serial cost %1.4f, concurrent cost %1.4f\n", i+1, serialCost, concurrentCost);
+			failures++;
+		}
+		instances++;
+	}
+	printf("%d instances, %d with different costs\n", instances, failures);
+	delete env;
+	delete m;
+}
+
+void CONCURRENTTEST::pancakeTest(int count)
+{
+	PancakePuzzle<LENGTH> pck;
+	PancakePuzzleState<LENGTH> goal;
+	goal.Reset();
+	BOBA<PancakePuzzleState<LENGTH>, PancakePuzzleAction, PancakePuzzle<LENGTH>> serialBoba, concurrentBoba;
+	concurrentBoba.SetConcurrentDirections(true);
+	std::vector<PancakePuzzleState<LENGTH>> thePath;
+	int failures = 0;
+
+	srandom(20170208);
+	for (int i = 0; i < count; i++)
+	{
+		PancakePuzzleState<LENGTH> start;
+		for (int x = 0; x < LENGTH; x++)
+			std::swap(start.puzzle[x], start.puzzle[x+random()%(LENGTH-x)]);
+
+		serialBoba.GetPath(&pck, start, goal, &pck, &pck, thePath);
+		double serialCost = pck.GetPathLength(thePath);
+		concurrentBoba.GetPath(&pck, start, goal, &pck, &pck, thePath);
+		double concurrentCost = pck.GetPathLength(thePath);
+		if (serialCost != concurrentCost)
+		{
+			std::cout << "Instance " << i+1 << " " << start << ": serial cost " << serialCost << ", concurrent cost " << concurrentCost << "\n";
+			failures++;
+		}
+	}
+	printf("%d instances, %d with different costs\n", count, failures);
+}
+
+void MEMORYLIMITTEST::gridTest(const char *mapFile, const char *scenFile, int teststart, int testend)
+{
+	Map *m = new Map(mapFile);
+	MapEnvironment *env = new MapEnvironment(m);
+	env->SetDiagonalCost(SQUARE_ROOT_OF2);
+
+	std::vector<int> group, startx, starty, goalx, goaly;
+	std::vector<double> expectedCost;
+	if (!GRIDMAPTEST::LoadBenchmark(group, startx, starty, goalx, goaly, expectedCost, scenFile))
+		return;
+
+	BOBA<xyLoc, tDirection, MapEnvironment> boba;
+	boba.SetMemoryLimit(limit);
+	std::vector<xyLoc> path;
+	xyLoc from, to;
+	int instances = 0, failures = 0;
+	uint64_t compactions = 0;
+
+	for (int i = teststart - 1; i < std::min(testend, (int)(startx.size())); i++)
+	{
+		from.x = startx[i];
+		from.y = starty[i];
+		to.x = goalx[i];
+		to.y = goaly[i];
+
+		boba.GetPath(env, from, to, env, env, path);
+		double cost = env->GetPathLength(path);
+		// scenario costs are rounded to five decimals
+		if (fabs(cost-expectedCost[i]) > 1e-3)
+		{
+			printf("Instance %d: cost %1.4f, optimal %1.4f\n", i+1, cost, expectedCost[i]);
+			failures++;
+		}
+		compactions += boba.GetCompactions();
+		instances++;
+	}
+	printf("%d instances, %d not optimal, %llu compactions\n", instances, failures, (unsigned long long)compactions);
+	delete env;
+	delete m;
+}
+
+void MEMORYLIMITTEST::pancakeTest(int count)
+{
+	using CONCURRENTTEST::LENGTH;
+	PancakePuzzle<LENGTH> pck;
+	PancakePuzzleState<LENGTH> goal;
+	goal.Reset();
+	BOBA<PancakePuzzleState<LENGTH>, PancakePuzzleAction, PancakePuzzle<LENGTH>> boba, limitedBoba;
+	limitedBoba.SetMemoryLimit(limit);
+	std::vector<PancakePuzzleState<LENGTH>> thePath;
+	int failures = 0;
+	uint64_t compactions = 0;
+
+	srandom(20170208);
+	for (int i = 0; i < count; i++)
+	{
+		PancakePuzzleState<LENGTH> start;
+		for (int x = 0; x < LENGTH; x++)
+			std::swap(start.puzzle[x], start.puzzle[x+random()%(LENGTH-x)]);
+
+		boba.GetPath(&pck, start, goal, &pck, &pck, thePath);
+		double cost = pck.GetPathLength(thePath);
+		limitedBoba.GetPath(&pck, start, goal, &pck, &pck, thePath);
+		double limitedCost = pck.GetPathLength(thePath);
+		if (cost != limitedCost)
+		{
+			std::cout << "Instance " << i+1 << " " << start << ": cost " << cost << ", with memory limit " << limitedCost << "\n";
+			failures++;
+		}
+		compactions += limitedBoba.GetCompactions();
+	}
+	printf("%d instances, %d with different costs, %llu compactions\n", count, failures, (unsigned long long)compactions);
+}
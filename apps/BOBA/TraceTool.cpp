@@ -0,0 +1,89 @@
+/*
+ *  TraceTool.cpp
+ *
+ *  Converts an expansion trace written by SearchTrace::Dump (build with
+ *  TRACE=1 and run BOBA with -trace <file>) to CSV, or prints histograms of
+ *  the expansions by g, h or f for each direction.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include "SearchTrace.h"
+
+void WriteCSV(const std::vector<SearchTraceRecord> &records, FILE *out);
+void PrintHistogram(const std::vector<SearchTraceRecord> &records, char value, double width);
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		printf("Usage: %s <trace file> csv [output file]\n", argv[0]);
+		printf("       %s <trace file> hist <g|h|f> [bin width]\n", argv[0]);
+		return 1;
+	}
+	std::vector<SearchTraceRecord> records;
+	if (!SearchTrace::Load(argv[1], records))
+	{
+		printf("Cannot read trace file %s\n", argv[1]);
+		return 1;
+	}
+	if (strcmp(argv[2], "csv") == 0)
+	{
+		FILE *out = stdout;
+		if (argc > 3 && (out = fopen(argv[3], "w")) == 0)
+		{
+			printf("Cannot write %s\n", argv[3]);
+			return 1;
+		}
+		WriteCSV(records, out);
+		if (out != stdout)
+			fclose(out);
+	}
+	else if (strcmp(argv[2], "hist") == 0 && argc > 3 && strchr("ghf", argv[3][0]) != 0)
+	{
+		double width = (argc > 4)?atof(argv[4]):1.0;
+		if (width <= 0)
+		{
+			printf("Bin width must be positive\n");
+			return 1;
+		}
+		PrintHistogram(records, argv[3][0], width);
+	}
+	else {
+		printf("Unknown command '%s'\n", argv[2]);
+		return 1;
+	}
+	return 0;
+}
+
+void WriteCSV(const std::vector<SearchTraceRecord> &records, FILE *out)
+{
+	fprintf(out, "time_ns,thread,direction,queue,g,h,f,hash\n");
+	for (const auto &r : records)
+		fprintf(out, "%llu,%d,%s,%d,%f,%f,%f,%llu\n", (unsigned long long)r.time, r.thread,
+				(r.direction == kTraceForward)?"forward":"backward", r.queue, r.g, r.h, r.f,
+				(unsigned long long)r.hash);
+}
+
+void PrintHistogram(const std::vector<SearchTraceRecord> &records, char value, double width)
+{
+	// bin -> {forward, backward} expansions
+	std::map<long, std::pair<uint64_t, uint64_t>> bins;
+	for (const auto &r : records)
+	{
+		double v = (value == 'g')?r.g:((value == 'h')?r.h:r.f);
+		auto &b = bins[(long)std::floor(v/width)];
+		if (r.direction == kTraceForward)
+			b.first++;
+		else
+			b.second++;
+	}
+	printf("%c\tforward\tbackward\n", value);
+	for (const auto &b : bins)
+		printf("%g\t%llu\t%llu\n", b.first*width, (unsigned long long)b.second.first, (unsigned long long)b.second.second);
+	printf("%llu expansions\n", (unsigned long long)records.size());
+}
@@ -981,12 +981,15 @@ void TSBiVRC(int bits, int compressionFactor, int first, int last)
 		h.heuristics.push_back(h3);
 		PermutationPuzzle::ArbitraryGoalPermutation<TopSpinState<N>, TopSpin<N, K>> p(&h, &ts);
 		//ZeroHeuristic<TopSpinState<N>> z;
+		HeuristicStats stats;
+		HeuristicStats::ThreadStats() = &stats;
 		TestTSBiVRC(&h, &p, first, last);
+		HeuristicStats::ThreadStats() = 0;
 
 		printf("Dynamic distribution\n");
 		for (int x = 0; x < 255; x++)
-			if (h.histogram[x] != 0)
-				printf("%d\t%llu\n", x, h.histogram[x]);
+			if (stats.histogram[x] != 0)
+				printf("%d\t%llu\n", x, (unsigned long long)stats.histogram[x]);
 	}
 	
 }
@@ -1249,12 +1252,15 @@ void TOHTest(int deltaFactor, int bits, int factor, int first, int last)
 	h.heuristics.resize(0);
 	h.heuristics.push_back(&pdb1);
 	h.heuristics.push_back(&pdb1a);
+	HeuristicStats stats;
+	HeuristicStats::ThreadStats() = &stats;
 	TestTOH<numDisks>(&h, first, last);
+	HeuristicStats::ThreadStats() = 0;
 	
 	printf("Dynamic distribution\n");
 	for (int x = 0; x < 255; x++)
-		if (h.histogram[x] != 0)
-			printf("%d\t%llu\n", x, h.histogram[x]);
+		if (stats.histogram[x] != 0)
+			printf("%d\t%llu\n", x, (unsigned long long)stats.histogram[x]);
 
 	
 //	printf("Starting TOH MOD\n");
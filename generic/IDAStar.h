@@ -16,6 +16,8 @@
 #include <ext/hash_map>
 #include "FPUtil.h"
 #include "vectorCache.h"
+#include "TranspositionTable.h"
+#include "NextBoundPredictor.h"
 
 //#define DO_LOGGING
 
@@ -24,7 +26,7 @@ typedef __gnu_cxx::hash_map<uint64_t, double> NodeHashTable;
 template <class state, class action>
 class IDAStar {
 public:
-	IDAStar() { useHashTable = usePathMax = false; storedHeuristic = false;}
+	IDAStar() { usePathMax = false; storedHeuristic = false; batchHeuristic = false; table = 0; growthRatio = 0; }
 	virtual ~IDAStar() {}
 	void GetPath(SearchEnvironment<state, action> *env, state from, state to,
 							 std::vector<state> &thePath);
@@ -33,20 +35,37 @@ public:
 
 	uint64_t GetNodesExpanded() { return nodesExpanded; }
 	uint64_t GetNodesTouched() { return nodesTouched; }
-	void ResetNodeCount() { nodesExpanded = nodesTouched = 0; }
+	/** Nodes not expanded because the transposition table had them at a lower g. */
+	uint64_t GetNodesPruned() { return nodesPruned; }
+	void ResetNodeCount() { nodesExpanded = nodesTouched = nodesPruned = 0; }
 	void SetUseBDPathMax(bool val) { usePathMax = val; }
+	/** Prune duplicate paths with this table (0 to disable). */
+	void SetTranspositionTable(TranspositionTable *t) { table = t; }
+	/**
+	 * Raise the bound so that each iteration expands about ratio times as
+	 * many nodes as the last (values <= 1 raise it to the smallest f-cost
+	 * above it). Optimality is kept by a final iteration that looks for a
+	 * solution cheaper than the one found.
+	 */
+	void SetNodeGrowthRatio(double ratio) { growthRatio = ratio; }
+	/**
+	 * Evaluate the successors of each expanded node with one BatchHCost call,
+	 * so that the lookups of PDB heuristics overlap. Batched values are exact,
+	 * so max trees no longer stop at the first PDB above the bound.
+	 */
+	void SetBatchHeuristic(bool val) { batchHeuristic = val; }
 	void SetHeuristic(Heuristic<state> *heur) { heuristic = heur; if (heur != 0) storedHeuristic = true;}
 private:
-	unsigned long long nodesExpanded, nodesTouched;
+	unsigned long long nodesExpanded, nodesTouched, nodesPruned;
 	
 	double DoIteration(SearchEnvironment<state, action> *env,
 					   state parent, state currState,
 					   std::vector<state> &thePath, double bound, double g,
-					   double maxH);
+					   double maxH, double knownH = -1);
 	double DoIteration(SearchEnvironment<state, action> *env,
 					   action forbiddenAction, state &currState,
 					   std::vector<action> &thePath, double bound, double g,
-					   double maxH, double parentH);
+					   double maxH, double parentH, double knownH = -1);
 	void PrintGHistogram()
 	{
 //		uint64_t early = 0, late = 0;
@@ -63,14 +82,21 @@ private:
 //		else
 //			printf("Weak heuristic - Expect MM >= MM0.\n");
 	}
+	double IterationHCost(const state &s, double bound, double g);
 	void UpdateNextBound(double currBound, double fCost);
+	double PredictNextBound(uint64_t expanded);
 	state goal;
 	double nextBound;
-	//NodeHashTable nodeTable;
+	double solutionCost;
+	double growthRatio;
+	NextBoundPredictor predictor;
 	bool usePathMax;
-	bool useHashTable;
+	TranspositionTable *table;
 	vectorCache<action> actCache;
 	bool storedHeuristic;
+	bool batchHeuristic;
+	vectorCache<state> childCache;
+	vectorCache<double> childHCache;
 	Heuristic<state> *heuristic;
 	std::vector<uint64_t> gCostHistogram;
 
@@ -88,19 +114,43 @@ void IDAStar<state, action>::GetPath(SearchEnvironment<state, action> *env,
 	if (!storedHeuristic)
 		heuristic = env;
 	nextBound = 0;
-	nodesExpanded = nodesTouched = 0;
+	nodesExpanded = nodesTouched = nodesPruned = 0;
 	thePath.resize(0);
 	UpdateNextBound(0, heuristic->HCost(from, to));
 	goal = to;
 	thePath.push_back(from);
+	// no solution costs less than lowerBound
+	double lowerBound = nextBound;
+	bool verifying = false;
+	std::vector<state> bestPath;
 	while (true) //thePath.size() == 0)
 	{
-		//nodeTable.clear();
+		if (table)
+			table->NewIteration();
 		gCostHistogram.clear();
 		gCostHistogram.resize(nextBound+1);
+		predictor.Reset(nextBound);
 		printf("Starting iteration with bound %f\n", nextBound);
+		uint64_t expanded = nodesExpanded;
 		if (DoIteration(env, from, from, thePath, nextBound, 0, 0) == 0)
+		{
+			if (!fgreater(solutionCost, lowerBound))
+				break;
+			// the bound skipped past lowerBound; look for a cheaper solution
+			bestPath = thePath;
+			thePath.resize(1);
+			nextBound = solutionCost-2*TOLERANCE;
+			verifying = true;
+		}
+		else if (verifying)
+		{
+			thePath = bestPath;
 			break;
+		}
+		else {
+			lowerBound = nextBound;
+			nextBound = PredictNextBound(nodesExpanded-expanded);
+		}
 		PrintGHistogram();
 	}
 	PrintGHistogram();
@@ -114,7 +164,7 @@ void IDAStar<state, action>::GetPath(SearchEnvironment<state, action> *env,
 	if (!storedHeuristic)
 		heuristic = env;
 	nextBound = 0;
-	nodesExpanded = nodesTouched = 0;
+	nodesExpanded = nodesTouched = nodesPruned = 0;
 	thePath.resize(0);
 
 	if (env->GoalTest(from, to))
@@ -125,15 +175,42 @@ void IDAStar<state, action>::GetPath(SearchEnvironment<state, action> *env,
 	goal = to;
 	std::vector<action> act;
 	env->GetActions(from, act);
-	while (thePath.size() == 0)
+	// no solution costs less than lowerBound
+	double lowerBound = nextBound;
+	bool verifying = false;
+	std::vector<action> bestPath;
+	while (true)
 	{
-		//nodeTable.clear();
+		if (table)
+			table->NewIteration();
 		gCostHistogram.clear();
 		gCostHistogram.resize(nextBound+1);
+		predictor.Reset(nextBound);
 		printf("Starting iteration with bound %f; %llu expanded, %llu generated\n", nextBound, nodesExpanded, nodesTouched);
 		fflush(stdout);
+		uint64_t expanded = nodesExpanded;
 		DoIteration(env, act[0], from, thePath, nextBound, 0, 0, rootH);
 		PrintGHistogram();
+		if (thePath.size() > 0)
+		{
+			if (!fgreater(solutionCost, lowerBound))
+				break;
+			// the bound skipped past lowerBound; look for a cheaper solution
+			printf("Found solution of cost %f; verifying against lower bound %f\n", solutionCost, lowerBound);
+			bestPath.swap(thePath);
+			thePath.resize(0);
+			nextBound = solutionCost-2*TOLERANCE;
+			verifying = true;
+		}
+		else if (verifying)
+		{
+			thePath.swap(bestPath);
+			break;
+		}
+		else {
+			lowerBound = nextBound;
+			nextBound = PredictNextBound(nodesExpanded-expanded);
+		}
 	}
 }
 
@@ -141,9 +218,10 @@ template <class state, class action>
 double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env,
 										   state parent, state currState,
 										   std::vector<state> &thePath, double bound, double g,
-										   double maxH)
+										   double maxH, double knownH)
 {
-	double h = heuristic->HCost(currState, goal);
+	// knownH is the value from the parent's batch, or negative if there was none
+	double h = (knownH >= 0)?knownH:IterationHCost(currState, bound, g);
 	// path max
 	if (usePathMax && fless(h, maxH))
 		h = maxH;
@@ -154,13 +232,24 @@ double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env
 		return h;
 	}
 	if (env->GoalTest(currState, goal))
+	{
+		solutionCost = g;
 		return 0;
+	}
+	if (table && table->IsDuplicate(env->GetStateHash(currState), g))
+	{
+		nodesPruned++;
+		return h;
+	}
 		
 	std::vector<state> neighbors;
 	env->GetSuccessors(currState, neighbors);
 	nodesTouched += neighbors.size();
 	nodesExpanded++;
 	gCostHistogram[g]++;
+	std::vector<double> neighborH(neighbors.size(), -1);
+	if (batchHeuristic && neighbors.size() > 0)
+		heuristic->BatchHCost(&neighbors[0], neighbors.size(), goal, &neighborH[0]);
 
 	for (unsigned int x = 0; x < neighbors.size(); x++)
 	{
@@ -169,7 +258,7 @@ double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env
 		thePath.push_back(neighbors[x]);
 		double edgeCost = env->GCost(currState, neighbors[x]);
 		double childH = DoIteration(env, currState, neighbors[x], thePath, bound,
-																g+edgeCost, maxH - edgeCost);
+																g+edgeCost, maxH - edgeCost, neighborH[x]);
 		if (env->GoalTest(thePath.back(), goal))
 			return 0;
 		thePath.pop_back();
@@ -192,9 +281,10 @@ template <class state, class action>
 double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env,
 										   action forbiddenAction, state &currState,
 										   std::vector<action> &thePath, double bound, double g,
-										   double maxH, double parentH)
+										   double maxH, double parentH, double knownH)
 {
-	double h = heuristic->HCost(currState, goal);//, parentH); // TODO: restore code that uses parent h-cost
+	// knownH is the value from the parent's batch, or negative if there was none
+	double h = (knownH >= 0)?knownH:IterationHCost(currState, bound, g);//, parentH); // TODO: restore code that uses parent h-cost
 	parentH = h;
 	// path max
 	if (usePathMax && fless(h, maxH))
@@ -207,7 +297,15 @@ double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env
 	}
 	// must do this after we check the f-cost bound
 	if (env->GoalTest(currState, goal))
+	{
+		solutionCost = g;
 		return -1; // found goal
+	}
+	if (table && table->IsDuplicate(env->GetStateHash(currState), g))
+	{
+		nodesPruned++;
+		return h;
+	}
 	
 	std::vector<action> &actions = *actCache.getItem();
 	env->GetActions(currState, actions);
@@ -218,6 +316,21 @@ double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env
 #ifdef t
 	func(currState, depth);
 #endif
+	std::vector<double> &childH = *childHCache.getItem();
+	childH.assign(actions.size(), -1);
+	if (batchHeuristic)
+	{
+		std::vector<state> &children = *childCache.getItem();
+		children.resize(actions.size());
+		for (unsigned int x = 0; x < actions.size(); x++)
+		{
+			children[x] = currState;
+			env->ApplyAction(children[x], actions[x]);
+		}
+		if (children.size() > 0)
+			heuristic->BatchHCost(&children[0], children.size(), goal, &childH[0]);
+		childCache.returnItem(&children);
+	}
 	
 	for (unsigned int x = 0; x < actions.size(); x++)
 	{
@@ -230,11 +343,12 @@ double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env
 		action a = actions[x];
 		env->InvertAction(a);
 
-		double childH = DoIteration(env, a, currState, thePath, bound,
-									g+edgeCost, maxH - edgeCost, parentH);
+		double returnedH = DoIteration(env, a, currState, thePath, bound,
+									g+edgeCost, maxH - edgeCost, parentH, childH[x]);
 		env->UndoAction(currState, actions[x]);
-		if (fequal(childH, -1)) // found goal
+		if (fequal(returnedH, -1)) // found goal
 		{
+			childHCache.returnItem(&childH);
 			actCache.returnItem(&actions);
 			return -1;
 		}
@@ -242,26 +356,44 @@ double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env
 		thePath.pop_back();
 
 		// pathmax
-		if (usePathMax && fgreater(childH-edgeCost, h))
+		if (usePathMax && fgreater(returnedH-edgeCost, h))
 		{
 			//			nodeTable[currState] = g;//+h
-			h = childH-edgeCost;
+			h = returnedH-edgeCost;
 			if (fgreater(g+h, bound))
 			{
 				UpdateNextBound(bound, g+h);
+				childHCache.returnItem(&childH);
 				actCache.returnItem(&actions);
 				return h;
 			}
 		}
 	}
+	childHCache.returnItem(&childH);
 	actCache.returnItem(&actions);
 	return h;
 }
 
 
+/**
+ * The h-cost of s, exact at least up to the smallest f-cost above the bound
+ * seen so far. Larger values are cut off and cannot lower the next bound.
+ * Until a node is cut off, and when the predictor or pathmax need every
+ * value, the full h-cost is used.
+ */
+template <class state, class action>
+double IDAStar<state, action>::IterationHCost(const state &s, double bound, double g)
+{
+	if (growthRatio > 1 || usePathMax || !fgreater(nextBound, bound))
+		return heuristic->HCost(s, goal);
+	return heuristic->HCostBounded(s, goal, nextBound-g);
+}
+
 template <class state, class action>
 void IDAStar<state, action>::UpdateNextBound(double currBound, double fCost)
 {
+	if (growthRatio > 1 && fgreater(fCost, currBound))
+		predictor.Add(fCost);
 	if (!fgreater(nextBound, currBound))
 	{
 		nextBound = fCost;
@@ -274,6 +406,17 @@ void IDAStar<state, action>::UpdateNextBound(double currBound, double fCost)
 	}
 }
 
+/**
+ * Called after an iteration without a solution, when nextBound is the
+ * smallest f-cost that exceeded the bound.
+ */
+template <class state, class action>
+double IDAStar<state, action>::PredictNextBound(uint64_t expanded)
+{
+	if (growthRatio <= 1)
+		return nextBound;
+	return std::max(nextBound, predictor.Predict(std::max<uint64_t>(1, (growthRatio-1)*expanded)));
+}
 
 #endif
 
@@ -12,6 +12,7 @@
 #include "AStarOpenClosed.h"
 #include "FPUtil.h"
 #include "Timer.h"
+#include "SearchTrace.h"
 #include <unordered_map>
 
 template <class state, int epsilon = 1>
@@ -377,6 +378,10 @@ void MM<state, action, environment, priorityQueue>::Expand(priorityQueue &curren
 	nodesExpanded++;
 	if (current.Lookup(nextID).reopened == false)
 		uniqueNodesExpanded++;
+	SEARCH_TRACE_EXPANSION((&current == &forwardQueue)?kTraceForward:kTraceBackward, kOpenList,
+						   current.Lookat(nextID).g, current.Lookat(nextID).h,
+						   std::max(current.Lookat(nextID).g+current.Lookat(nextID).h, current.Lookat(nextID).g*2+epsilon),
+						   env->GetStateHash(current.Lookat(nextID).data));
 
 	// decrease count from parent
 	{
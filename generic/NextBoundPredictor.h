@@ -0,0 +1,83 @@
+/*
+ *  NextBoundPredictor.h
+ *  hog2
+ *
+ *  Chooses the next IDA* bound from the f-costs that exceeded the current one.
+ */
+
+#ifndef NEXTBOUNDPREDICTOR_H
+#define NEXTBOUNDPREDICTOR_H
+
+#include <cmath>
+#include <stdint.h>
+#include <algorithm>
+
+/**
+ * Picks a bound that admits a given number of the nodes cut off in the last
+ * iteration, in the style of IDA*-CR, instead of only the cheapest one. Cut
+ * off f-costs are counted in buckets that double in width with the distance
+ * from the bound, so that nearby real-valued costs are still told apart.
+ * Each bucket keeps its largest f-cost, and the predicted bound is always one
+ * of those, so integer costs are never rounded past.
+ */
+class NextBoundPredictor {
+public:
+	NextBoundPredictor() { Reset(0); }
+	/** Start counting the f-costs that exceed bound. */
+	void Reset(double bound)
+	{
+		this->bound = bound;
+		std::fill(counts, counts+kBuckets, 0);
+		std::fill(maxF, maxF+kBuckets, 0);
+	}
+	void Add(double f)
+	{
+		int b = Bucket(f-bound);
+		counts[b]++;
+		maxF[b] = std::max(maxF[b], f);
+	}
+	/** Add the counts of another predictor with the same bound. */
+	void Merge(const NextBoundPredictor &p)
+	{
+		for (int x = 0; x < kBuckets; x++)
+		{
+			counts[x] += p.counts[x];
+			maxF[x] = std::max(maxF[x], p.maxF[x]);
+		}
+	}
+	/**
+	 * Returns the smallest bound that admits at least target of the cut off
+	 * nodes, or one that admits all of them if fewer were cut off; 0 if
+	 * none were.
+	 */
+	double Predict(uint64_t target) const
+	{
+		uint64_t total = 0;
+		double last = 0;
+		for (int x = 0; x < kBuckets; x++)
+		{
+			if (counts[x] == 0)
+				continue;
+			total += counts[x];
+			last = maxF[x];
+			if (total >= target)
+				break;
+		}
+		return last;
+	}
+private:
+	static const int kBuckets = 48;
+	// bucket 0 holds everything closer to the bound than this
+	static constexpr double kMinStep = 1.0/1024;
+	static int Bucket(double distance)
+	{
+		if (!(distance >= kMinStep))
+			return 0;
+		return std::min(kBuckets-1, 1+std::ilogb(distance/kMinStep));
+	}
+	double bound;
+	uint64_t counts[kBuckets];
+	double maxF[kBuckets];
+};
+
+#endif
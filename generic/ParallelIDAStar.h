@@ -11,51 +11,95 @@
 
 #include <iostream>
 #include "SearchEnvironment.h"
-#include <ext/hash_map>
 #include "FPUtil.h"
-#include "vectorCache.h"
-#include "SharedQueue.h"
+#include "WorkerPool.h"
+#include "TranspositionTable.h"
+#include "NextBoundPredictor.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <thread>
 
-const int workDepth = 5;
-
+/**
+ * A subtree of one iteration: the actions leading to its root from the
+ * start state. The root itself has not been evaluated yet.
+ */
 template <class action>
 struct workUnit {
-	action pre[workDepth];
-	std::vector<action> solution;
-	std::vector<int> gHistogram;
-	std::vector<int> fHistogram;
-	double nextBound;
-	uint64_t expanded, touched;
-	int unitNumber;
+	std::vector<action> pre;
 };
 
+/**
+ * Parallel IDA* with work stealing. Each thread owns a deque of subtrees; it
+ * takes work from the back of its own deque and steals from the front of the
+ * others. A thread searches its subtree depth-first with an explicit stack,
+ * and when other threads are idle it gives away the untried siblings at the
+ * shallowest level of that stack, which are usually the largest pieces left.
+ * The threads persist across iterations and searches, and the first solution
+ * found stops the others at their next expansion.
+ */
 template <class environment, class state, class action>
 class ParallelIDAStar {
 public:
-	ParallelIDAStar() { storedHeuristic = false;}
+	ParallelIDAStar() { storedHeuristic = false; table = 0; growthRatio = 0; numThreads = std::max(1u, std::thread::hardware_concurrency()); }
 	virtual ~ParallelIDAStar() {}
 	//	void GetPath(environment *env, state from, state to,
 	//				 std::vector<state> &thePath);
 	void GetPath(environment *env, state from, state to,
 				 std::vector<action> &thePath);
-	
+
 	uint64_t GetNodesExpanded() { return nodesExpanded; }
 	uint64_t GetNodesTouched() { return nodesTouched; }
-	void ResetNodeCount() { nodesExpanded = nodesTouched = 0; }
+	/** Nodes not expanded because the transposition table had them at a lower g. */
+	uint64_t GetNodesPruned() { return nodesPruned; }
+	void ResetNodeCount() { nodesExpanded = nodesTouched = nodesPruned = 0; }
 	void SetHeuristic(Heuristic<state> *heur) { heuristic = heur; if (heur != 0) storedHeuristic = true;}
+	/** Threads used by the next search, including the calling thread. */
+	void SetNumThreads(int count) { numThreads = std::max(1, count); }
+	/** Subtrees handed from busy threads to idle ones in the last search. */
+	uint64_t GetWorkSplits() const { return workSplits; }
+	/** Prune duplicate paths with this table, shared by all threads (0 to disable). */
+	void SetTranspositionTable(TranspositionTable *t) { table = t; }
+	/**
+	 * Raise the bound so that each iteration expands about ratio times as
+	 * many nodes as the last (values <= 1 raise it to the smallest f-cost
+	 * above it). Optimality is kept by a final iteration that looks for a
+	 * solution cheaper than the one found.
+	 */
+	void SetNodeGrowthRatio(double ratio) { growthRatio = ratio; }
 private:
-	unsigned long long nodesExpanded, nodesTouched;
-	
-	void StartThreadedIteration(environment env, state startState, double bound);
-	void DoIteration(environment *env,
-					 action forbiddenAction, state &currState,
-					 std::vector<action> &thePath, double bound, double g,
-					 workUnit<action> &w, vectorCache<action> &cache);
-	void GenerateWork(environment *env,
-					  action forbiddenAction, state &currState,
-					  std::vector<action> &thePath);
-	
+	unsigned long long nodesExpanded, nodesTouched, nodesPruned;
+
+	// the stack of one thread's depth-first search
+	struct searchFrame {
+		std::vector<action> actions;
+		size_t next; // next action to try
+		double g;
+	};
+	// everything one thread owns during an iteration
+	struct threadData {
+		environment env; // environments may keep scratch state, so each thread has its own
+		state s;
+		std::deque<workUnit<action>> work;
+		std::mutex workLock;
+		std::atomic<size_t> queued; // work.size(), readable without the lock
+		std::vector<searchFrame> stack;
+		std::vector<action> path;
+		std::vector<uint64_t> gHistogram;
+		std::vector<uint64_t> fHistogram;
+		NextBoundPredictor predictor;
+		double nextBound;
+		uint64_t expanded, touched, pruned, splits;
+		threadData(const environment &e) :env(e), queued(0) {}
+	};
+
+	void Worker(threadData &t, int threadID, double bound);
+	bool GetWork(threadData &t, int threadID, workUnit<action> &w);
+	void SearchSubtree(threadData &t, const workUnit<action> &w, double bound);
+	bool Visit(threadData &t, double g, bool hasForbidden, const action &forbidden, double bound);
+	void SplitWork(threadData &t);
+
 	void PrintGHistogram()
 	{
 		return;
@@ -84,17 +128,26 @@ private:
 		printf("\n");
 	}
 	void UpdateNextBound(double currBound, double fCost);
-	state goal;
+	state start, goal;
 	double nextBound;
-	//vectorCache<action> actCache;
 	bool storedHeuristic;
 	Heuristic<state> *heuristic;
+	TranspositionTable *table;
 	std::vector<uint64_t> gCostHistogram;
 	std::vector<uint64_t> fCostHistogram;
-	std::vector<workUnit<action>> work;
-	std::vector<std::thread*> threads;
-	SharedQueue<int> q;
-	int foundSolution;
+	int numThreads;
+	std::unique_ptr<WorkerPool> pool;
+	std::vector<std::unique_ptr<threadData>> threads;
+	// subtrees queued or being searched; the iteration ends when it reaches 0
+	std::atomic<uint64_t> outstanding;
+	// threads looking for work; busy threads split their stack while it is non-zero
+	std::atomic<int> hungry;
+	std::atomic<bool> foundSolution;
+	std::mutex solutionLock;
+	std::vector<action> solution;
+	double solutionCost;
+	double growthRatio;
+	uint64_t workSplits;
 };
 
 //template <class state, class action>
@@ -110,237 +163,326 @@ void ParallelIDAStar<environment, state, action>::GetPath(environment *env,
 														  state from, state to,
 														  std::vector<action> &thePath)
 {
-	int numThreads = std::thread::hardware_concurrency();
 	if (!storedHeuristic)
 		heuristic = env;
 	nextBound = 0;
-	nodesExpanded = nodesTouched = 0;
+	nodesExpanded = nodesTouched = nodesPruned = 0;
+	workSplits = 0;
 	thePath.resize(0);
-	work.resize(0);
 
 	// Set class member
+	start = from;
 	goal = to;
-	
+
 	if (env->GoalTest(from, to))
 		return;
-	
-	std::vector<action> act;
-	env->GetActions(from, act);
-	
+
 	double rootH = heuristic->HCost(from, to);
 	UpdateNextBound(0, rootH);
-	
-	// builds a list of all states at a fixed depth
-	// we will then search them in parallel
-	GenerateWork(env, act[0], from, thePath);
-	for (int x = 0; x < work.size(); x++)
-		work[x].unitNumber = x;
-	printf("%lu pieces of work generated\n", work.size());
-	foundSolution = work.size() + 1;
-	
-	while (foundSolution > work.size())
+
+	if (!pool || pool->GetNumThreads() != numThreads)
+		pool.reset(new WorkerPool(numThreads));
+	threads.resize(0);
+	for (int x = 0; x < numThreads; x++)
+		threads.push_back(std::unique_ptr<threadData>(new threadData(*env)));
+	foundSolution = false;
+	solution.resize(0);
+
+	// no solution costs less than lowerBound
+	double lowerBound = nextBound;
+	bool verifying = false;
+	while (true)
 	{
+		if (table)
+			table->NewIteration();
 		gCostHistogram.clear();
 		gCostHistogram.resize(nextBound+1);
 		fCostHistogram.clear();
 		fCostHistogram.resize(nextBound+1);
-		threads.resize(0);
-		
+
 		printf("Starting iteration with bound %f; %llu expanded, %llu generated\n", nextBound, nodesExpanded, nodesTouched);
 		fflush(stdout);
-		
-		for (int x = 0; x < work.size(); x++)
+
+		for (auto &t : threads)
 		{
-			q.Add(x);
+			t->work.clear();
+			t->queued = 0;
+			t->gHistogram.assign(nextBound+1, 0);
+			t->fHistogram.assign(nextBound+1, 0);
+			t->predictor.Reset(nextBound);
+			t->nextBound = DBL_MAX;
+			t->expanded = t->touched = t->pruned = t->splits = 0;
 		}
-		for (int x = 0; x < numThreads; x++)
+		// the whole tree starts with one thread; the others steal from it
+		threads[0]->work.push_back(workUnit<action>());
+		threads[0]->queued = 1;
+		outstanding = 1;
+		hungry = 0;
+		double bound = nextBound;
+		pool->ParallelFor(numThreads, [&](size_t, int threadID) {
+			Worker(*threads[threadID], threadID, bound);
+		});
+
+		double bestBound = DBL_MAX;
+		uint64_t expanded = 0;
+		for (auto &t : threads)
 		{
-			threads.push_back(new std::thread(&ParallelIDAStar<environment, state, action>::StartThreadedIteration, this,
-												 *env, from, nextBound));
+			for (size_t y = 0; y < t->gHistogram.size(); y++)
+			{
+				gCostHistogram[y] += t->gHistogram[y];
+				fCostHistogram[y] += t->fHistogram[y];
+			}
+			if (t != threads[0])
+				threads[0]->predictor.Merge(t->predictor);
+			bestBound = std::min(bestBound, t->nextBound);
+			expanded += t->expanded;
+			nodesTouched += t->touched;
+			nodesPruned += t->pruned;
+			workSplits += t->splits;
 		}
-		for (int x = 0; x < threads.size(); x++)
+		nodesExpanded += expanded;
+		PrintGHistogram();
+		if (foundSolution)
 		{
-			threads[x]->join();
-			delete threads[x];
-			threads[x] = 0;
+			thePath = solution;
+			if (!fgreater(solutionCost, lowerBound))
+				return;
+			// the bound skipped past lowerBound; look for a cheaper solution
+			printf("Found solution of cost %f; verifying against lower bound %f\n", solutionCost, lowerBound);
+			nextBound = solutionCost-2*TOLERANCE;
+			foundSolution = false;
+			verifying = true;
+			continue;
 		}
-		double bestBound = nextBound*10; // FIXME: Better ways to do bounds
-		for (int x = 0; x < work.size(); x++)
+		if (verifying || bestBound == DBL_MAX)
+			return; // the last solution is optimal, or there is none
+		lowerBound = nextBound = bestBound;
+		if (growthRatio > 1)
+			nextBound = std::max(nextBound, threads[0]->predictor.Predict(std::max<uint64_t>(1, (growthRatio-1)*expanded)));
+	}
+}
+
+/**
+ * Search subtrees until there are none left in this iteration. Several calls
+ * may run for the same thread id one after another; the later ones find no
+ * work and return.
+ */
+template <class environment, class state, class action>
+void ParallelIDAStar<environment, state, action>::Worker(threadData &t, int threadID, double bound)
+{
+	workUnit<action> w;
+	while (GetWork(t, threadID, w))
+	{
+		SearchSubtree(t, w, bound);
+		outstanding--;
+	}
+}
+
+/**
+ * Take the newest subtree of this thread, or steal the oldest one of another
+ * thread. Waits while other threads may still split off work; returns false
+ * once the iteration is over.
+ */
+template <class environment, class state, class action>
+bool ParallelIDAStar<environment, state, action>::GetWork(threadData &t, int threadID, workUnit<action> &w)
+{
+	bool waiting = false;
+	while (true)
+	{
 		{
-			for (int y = 0; y < work[x].gHistogram.size(); y++)
+			std::lock_guard<std::mutex> l(t.workLock);
+			if (t.work.size() > 0)
 			{
-				gCostHistogram[y] += work[x].gHistogram[y];
-				fCostHistogram[y] += work[x].fHistogram[y];
+				w = std::move(t.work.back());
+				t.work.pop_back();
+				t.queued.store(t.work.size(), std::memory_order_relaxed);
+				if (waiting)
+					hungry--;
+				return true;
 			}
-			if (work[x].nextBound > nextBound && work[x].nextBound < bestBound)
-			{
-				//printf("Got bound of %1.0f from work %d\n", work[x].nextBound, x);
-				bestBound = work[x].nextBound;
-			}
-			nodesExpanded += work[x].expanded;
-			nodesTouched += work[x].touched;
-			if (work[x].solution.size() != 0)
+		}
+		for (int x = 1; x < numThreads; x++)
+		{
+			threadData &victim = *threads[(threadID+x)%numThreads];
+			std::lock_guard<std::mutex> l(victim.workLock);
+			if (victim.work.size() > 0)
 			{
-//				printf(">>Solution histogram>>\n");
-//				PrintGHistogram();
-//				printf("<<Solution histogram<<\n");
-				thePath = work[x].solution;
+				w = std::move(victim.work.front());
+				victim.work.pop_front();
+				victim.queued.store(victim.work.size(), std::memory_order_relaxed);
+				if (waiting)
+					hungry--;
+				return true;
 			}
 		}
-		nextBound = bestBound;
-//		printf(">>Full histogram>>\n");
-//		PrintGHistogram();
-//		printf("<<Full histogram<<\n");
-		if (thePath.size() != 0)
-			return;
+		if (outstanding.load() == 0)
+		{
+			if (waiting)
+				hungry--;
+			return false;
+		}
+		if (!waiting)
+		{
+			hungry++;
+			waiting = true;
+		}
+		std::this_thread::yield();
 	}
 }
 
 template <class environment, class state, class action>
-void ParallelIDAStar<environment, state, action>::GenerateWork(environment *env,
-															   action forbiddenAction, state &currState,
-															   std::vector<action> &thePath)
+void ParallelIDAStar<environment, state, action>::SearchSubtree(threadData &t, const workUnit<action> &w, double bound)
 {
-	if (thePath.size() >= workDepth)
-	{
-		workUnit<action> w;
-		for (int x = 0; x < workDepth; x++)
-		{
-			w.pre[x] = thePath[x];
-		}
-		work.push_back(w);
+	if (foundSolution)
 		return;
+	t.s = start;
+	t.path = w.pre;
+	t.stack.resize(0);
+	double g = 0;
+	for (const action &a : w.pre)
+	{
+		g += t.env.GCost(t.s, a);
+		t.env.ApplyAction(t.s, a);
 	}
-	
-	std::vector<action> actions;
-	env->GetActions(currState, actions);
-	nodesTouched += actions.size();
-	nodesExpanded++;
-	int depth = (int)thePath.size();
-	
-	for (unsigned int x = 0; x < actions.size(); x++)
+	// only read when hasForbidden; value-initialized for the root work item
+	action forbidden = action();
+	bool hasForbidden = (w.pre.size() > 0);
+	if (hasForbidden)
 	{
-		if ((depth != 0) && (actions[x] == forbiddenAction))
-			continue;
-		
-		thePath.push_back(actions[x]);
-		
-		env->ApplyAction(currState, actions[x]);
-		action a = actions[x];
-		env->InvertAction(a);
-		GenerateWork(env, a, currState, thePath);
-		env->UndoAction(currState, actions[x]);
-		thePath.pop_back();
+		forbidden = w.pre.back();
+		t.env.InvertAction(forbidden);
 	}
-	
-}
+	if (!Visit(t, g, hasForbidden, forbidden, bound))
+		return;
 
-template <class environment, class state, class action>
-void ParallelIDAStar<environment, state, action>::StartThreadedIteration(environment env, state startState, double bound)
-{
-	vectorCache<action> actCache;
-	std::vector<action> thePath;
-	while (true)
+	while (t.stack.size() > 0 && !foundSolution)
 	{
-		int nextValue;
-		// All values put in before threads start. Once the queue is empty we're done
-		if (q.Remove(nextValue) == false)
-			break;
-		
-		thePath.resize(0);
-		bool passedLimit = false;
-		double g = 0;
-		workUnit<action> localWork = work[nextValue];
-		localWork.solution.resize(0);
-		localWork.gHistogram.clear();
-		localWork.gHistogram.resize(bound+1);
-		localWork.fHistogram.clear();
-		localWork.fHistogram.resize(bound+1);
-		localWork.nextBound = 10*bound;//FIXME: Better ways to do this
-		localWork.expanded = 0;
-		localWork.touched = 0;
-
-		for (int x = 0; x < workDepth; x++)
+		if (hungry.load(std::memory_order_relaxed) > 0)
+			SplitWork(t);
+		searchFrame &f = t.stack.back();
+		if (f.next == f.actions.size())
 		{
-			g += env.GCost(startState, localWork.pre[x]);
-			env.ApplyAction(startState, localWork.pre[x]);
-			thePath.push_back(localWork.pre[x]);
-			
-			if (!passedLimit && fgreater(g+heuristic->HCost(startState, goal), bound))
+			t.stack.pop_back();
+			if (t.stack.size() > 0)
 			{
-				localWork.nextBound = g+heuristic->HCost(startState, goal);
-				passedLimit = true;
+				t.env.UndoAction(t.s, t.path.back());
+				t.path.pop_back();
 			}
+			continue;
 		}
-
-		action last = localWork.pre[workDepth-1];
-		env.InvertAction(last);
-		
-		if (!passedLimit)
-		{
-			DoIteration(&env, last, startState, thePath, bound, g, localWork, actCache);
-		}
-		
-		for (int x = workDepth-1; x >= 0; x--)
+		action a = f.actions[f.next++];
+		double childG = f.g+t.env.GCost(t.s, a);
+		t.env.ApplyAction(t.s, a);
+		t.path.push_back(a);
+		action inverse = a;
+		t.env.InvertAction(inverse);
+		// f may be invalidated by Visit pushing a frame
+		if (!Visit(t, childG, true, inverse, bound))
 		{
-			env.UndoAction(startState, localWork.pre[x]);
-			g -= env.GCost(startState, localWork.pre[x]);
+			t.env.UndoAction(t.s, a);
+			t.path.pop_back();
 		}
-		work[nextValue] = localWork;
 	}
 }
 
-
+/**
+ * Check the f-cost of the current state and the goal test, and push a frame
+ * with its actions if it is expanded. Returns whether a frame was pushed.
+ */
 template <class environment, class state, class action>
-void ParallelIDAStar<environment, state, action>::DoIteration(environment *env,
-															  action forbiddenAction, state &currState,
-															  std::vector<action> &thePath, double bound, double g,
-															  workUnit<action> &w, vectorCache<action> &cache)
+bool ParallelIDAStar<environment, state, action>::Visit(threadData &t, double g, bool hasForbidden, const action &forbidden, double bound)
 {
-	double h = heuristic->HCost(currState, goal);//, parentH); // TODO: restore code that uses parent h-cost
-	
+	// h only has to be exact up to this thread's next bound, which is above
+	// the iteration bound once set; the predictor needs every value
+	double h;
+	if (growthRatio > 1 || t.nextBound == DBL_MAX)
+		h = heuristic->HCost(t.s, goal);
+	else
+		h = heuristic->HCostBounded(t.s, goal, t.nextBound-g);
+
 	if (fgreater(g+h, bound))
 	{
-		if (g+h < w.nextBound)
-			w.nextBound = g+h;
-		return;
+		if (g+h < t.nextBound)
+			t.nextBound = g+h;
+		if (growthRatio > 1)
+			t.predictor.Add(g+h);
+		return false;
 	}
 
 	// must do this after we check the f-cost bound
-	if (env->GoalTest(currState, goal))
+	if (t.env.GoalTest(t.s, goal))
 	{
-		w.solution = thePath;
-		foundSolution = std::min(foundSolution,w.unitNumber);
-		return;
+		std::lock_guard<std::mutex> l(solutionLock);
+		if (!foundSolution)
+		{
+			solution = t.path;
+			solutionCost = g;
+			foundSolution = true;
+		}
+		return false;
+	}
+	if (table && table->IsDuplicate(t.env.GetStateHash(t.s), g))
+	{
+		t.pruned++;
+		return false;
 	}
-	
-	std::vector<action> &actions = *cache.getItem();
-	env->GetActions(currState, actions);
-	w.touched += actions.size();
-	w.expanded++;
-	w.gHistogram[g]++;
-	w.fHistogram[g+h]++;
 
-	for (unsigned int x = 0; x < actions.size(); x++)
+	t.stack.resize(t.stack.size()+1);
+	searchFrame &f = t.stack.back();
+	f.next = 0;
+	f.g = g;
+	t.env.GetActions(t.s, f.actions);
+	t.touched += f.actions.size();
+	t.expanded++;
+	t.gHistogram[g]++;
+	t.fHistogram[g+h]++;
+	if (hasForbidden)
 	{
-		if (actions[x] == forbiddenAction)
-			continue;
-		
-		thePath.push_back(actions[x]);
-		
-		double edgeCost = env->GCost(currState, actions[x]);
-		env->ApplyAction(currState, actions[x]);
-		action a = actions[x];
-		env->InvertAction(a);
-		DoIteration(env, a, currState, thePath, bound, g+edgeCost, w, cache);
-		env->UndoAction(currState, actions[x]);
-		thePath.pop_back();
-		if (foundSolution <= w.unitNumber)
-			break;
+		for (size_t x = 0; x < f.actions.size(); x++)
+		{
+			if (f.actions[x] == forbidden)
+			{
+				f.actions.erase(f.actions.begin()+x);
+				break;
+			}
+		}
 	}
-	cache.returnItem(&actions);
+	return true;
 }
 
+/**
+ * Move the untried actions of the shallowest frame that has any to this
+ * thread's deque, where idle threads can steal them. The lock is only taken
+ * when work is moved; only this thread adds to its deque, so a stale count
+ * at worst delays a split to the next node.
+ */
+template <class environment, class state, class action>
+void ParallelIDAStar<environment, state, action>::SplitWork(threadData &t)
+{
+	if (t.queued.load(std::memory_order_relaxed) > 0)
+		return; // there is still work to steal
+	// path[0, base+d) leads to the state of frame d
+	size_t base = t.path.size()+1-t.stack.size();
+	for (size_t d = 0; d < t.stack.size(); d++)
+	{
+		searchFrame &f = t.stack[d];
+		// keep the last untried action when it is the current frame's only one
+		if (f.next >= f.actions.size() || (d+1 == t.stack.size() && f.next+1 == f.actions.size()))
+			continue;
+		std::lock_guard<std::mutex> l(t.workLock);
+		outstanding += f.actions.size()-f.next;
+		for (size_t x = f.next; x < f.actions.size(); x++)
+		{
+			t.work.push_back(workUnit<action>());
+			t.work.back().pre.assign(t.path.begin(), t.path.begin()+base+d);
+			t.work.back().pre.push_back(f.actions[x]);
+			t.splits++;
+		}
+		t.queued.store(t.work.size(), std::memory_order_relaxed);
+		f.next = f.actions.size();
+		return;
+	}
+}
 
 template <class environment, class state, class action>
 void ParallelIDAStar<environment, state, action>::UpdateNextBound(double currBound, double fCost)
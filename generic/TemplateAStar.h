@@ -152,6 +152,9 @@ private:
 	std::vector<uint64_t> neighborID;
 	std::vector<double> edgeCosts;
 	std::vector<dataLocation> neighborLoc;
+	std::vector<double> neighborH; // h of the new neighbors
+	std::vector<state> newNeighbors; // new neighbors, evaluated in one batch
+	std::vector<double> newNeighborH;
 	environment *env;
 	bool stopAfterGoal;
 	
@@ -334,6 +337,7 @@ bool TemplateAStar<state,action,environment,openList>::DoSingleSearchStep(std::v
 	edgeCosts.resize(0);
 	neighborID.resize(0);
 	neighborLoc.resize(0);
+	newNeighbors.resize(0);
 	
 //	std::cout << "Expanding: " << openClosedList.Lookup(nodeid).data << " with f:";
 //	std::cout << openClosedList.Lookup(nodeid).g+openClosedList.Lookup(nodeid).h << std::endl;
@@ -348,19 +352,30 @@ bool TemplateAStar<state,action,environment,openList>::DoSingleSearchStep(std::v
 		neighborLoc.push_back(openClosedList.Lookup(env->GetStateHash(neighbors[x]), theID));
 		neighborID.push_back(theID);
 		edgeCosts.push_back(env->GCost(openClosedList.Lookup(nodeid).data, neighbors[x]));
+		if (neighborLoc.back() == kNotFound)
+			newNeighbors.push_back(neighbors[x]);
+	}
+	// 2. evaluate the new children together, so their lookups overlap
+	newNeighborH.resize(newNeighbors.size());
+	if (newNeighbors.size() > 0)
+		theHeuristic->BatchHCost(&newNeighbors[0], newNeighbors.size(), goal, &newNeighborH[0]);
+	neighborH.resize(neighbors.size());
+	for (unsigned int x = 0, next = 0; x < neighbors.size(); x++)
+	{
+		if (neighborLoc[x] == kNotFound)
+			neighborH[x] = newNeighborH[next++];
 		if (useBPMX)
 		{
-			if (neighborLoc.back() != kNotFound)
+			if (neighborLoc[x] != kNotFound)
 			{
 				if (!directed)
-					bestH = std::max(bestH, openClosedList.Lookup(theID).h-edgeCosts.back());
-				lowHC = std::min(lowHC, openClosedList.Lookup(theID).h+edgeCosts.back());
+					bestH = std::max(bestH, openClosedList.Lookup(neighborID[x]).h-edgeCosts[x]);
+				lowHC = std::min(lowHC, openClosedList.Lookup(neighborID[x]).h+edgeCosts[x]);
 			}
 			else {
-				double tmpH = theHeuristic->HCost(neighbors[x], goal);
 				if (!directed)
-					bestH = std::max(bestH, tmpH-edgeCosts.back());
-				lowHC = std::min(lowHC, tmpH+edgeCosts.back());
+					bestH = std::max(bestH, neighborH[x]-edgeCosts[x]);
+				lowHC = std::min(lowHC, neighborH[x]+edgeCosts[x]);
 			}
 		}
 	}
@@ -440,7 +455,7 @@ bool TemplateAStar<state,action,environment,openList>::DoSingleSearchStep(std::v
 					openClosedList.AddClosedNode(neighbors[x],
 												 env->GetStateHash(neighbors[x]),
 												 openClosedList.Lookup(nodeid).g+edgeCosts[x],
-												 std::max(theHeuristic->HCost(neighbors[x], goal), openClosedList.Lookup(nodeid).h-edgeCosts[x]),
+												 std::max(neighborH[x], openClosedList.Lookup(nodeid).h-edgeCosts[x]),
 												 nodeid);
 				}
 				else { // add node to open list
@@ -453,14 +468,14 @@ bool TemplateAStar<state,action,environment,openList>::DoSingleSearchStep(std::v
 						openClosedList.AddOpenNode(neighbors[x],
 												   env->GetStateHash(neighbors[x]),
 												   openClosedList.Lookup(nodeid).g+edgeCosts[x],
-												   std::max(weight*theHeuristic->HCost(neighbors[x], goal), openClosedList.Lookup(nodeid).h-edgeCosts[x]),
+												   std::max(weight*neighborH[x], openClosedList.Lookup(nodeid).h-edgeCosts[x]),
 												   nodeid);
 					}
 					else {
 						openClosedList.AddOpenNode(neighbors[x],
 												   env->GetStateHash(neighbors[x]),
 												   openClosedList.Lookup(nodeid).g+edgeCosts[x],
-												   weight*theHeuristic->HCost(neighbors[x], goal),
+												   weight*neighborH[x],
 												   nodeid);
 					}
 //					if (loc == -1)
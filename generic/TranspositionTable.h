@@ -0,0 +1,126 @@
+/*
+ *  TranspositionTable.h
+ *  hog2
+ *
+ *  Fixed-size table of the g-costs with which IDA* expanded states in the
+ *  current iteration, used to prune duplicate paths.
+ */
+
+#ifndef TRANSPOSITIONTABLE_H
+#define TRANSPOSITIONTABLE_H
+
+#include <atomic>
+#include <cassert>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include "FPUtil.h"
+#include "EpochIndexTable.h"
+
+/**
+ * Lock-free table of (state hash, g, iteration) entries, safe to share
+ * between the threads of one search. Each entry is two words written with
+ * plain atomic stores; the first word holds the hash xor the second, so an
+ * entry torn by a concurrent write fails the key check and reads as a miss.
+ * The iteration is kept in the low 16 bits of g's mantissa, which changes
+ * g by a relative 2^-36 at most.
+ *
+ * Entries live in buckets of two. The first slot keeps the shallowest
+ * (lowest g) state of the iteration that hashed there, which guards the
+ * largest subtree; the second slot is always replaced. Entries of earlier
+ * iterations are stale and are replaced first. A table must only be used by
+ * one search at a time: the g-costs are relative to that search's start.
+ */
+class TranspositionTable {
+public:
+	/** Use at least numEntries entries (rounded up to a power of two). */
+	TranspositionTable(size_t numEntries = 1<<20)
+	{
+		size_t count = 2;
+		while (count < numEntries)
+			count <<= 1;
+		entries.reset(new entry[count]);
+		mask = count-1;
+		age = 0;
+		Clear();
+	}
+	/** Remove all entries. Not thread safe. */
+	void Clear()
+	{
+		for (size_t x = 0; x <= mask; x++)
+		{
+			entries[x].check.store(0, std::memory_order_relaxed);
+			entries[x].data.store(0, std::memory_order_relaxed);
+		}
+		age = 1;
+	}
+	/**
+	 * Start a new iteration, so that all existing entries become stale.
+	 * Must be called between iterations, not while threads use the table.
+	 */
+	void NewIteration()
+	{
+		if (++age > kAgeMask)
+			Clear();
+	}
+	size_t GetNumEntries() const { return mask+1; }
+	size_t MemoryUsage() const { return (mask+1)*sizeof(entry); }
+
+	/**
+	 * Returns true if the state was already expanded in this iteration with
+	 * a g-cost no larger than g, in which case its subtree is covered and
+	 * need not be searched again. Otherwise records g for the state.
+	 */
+	bool IsDuplicate(uint64_t key, double g)
+	{
+		uint64_t data = Encode(g);
+		entry *bucket = &entries[MixHashBits(key)&mask&~(size_t)1];
+		for (int x = 0; x < 2; x++)
+		{
+			uint64_t d = bucket[x].data.load(std::memory_order_relaxed);
+			uint64_t c = bucket[x].check.load(std::memory_order_relaxed);
+			if ((c^d) != key || (d&kAgeMask) != age)
+				continue;
+			if (!fless(g, Decode(d)))
+				return true;
+			Store(bucket[x], key, data);
+			return false;
+		}
+		uint64_t d = bucket[0].data.load(std::memory_order_relaxed);
+		if ((d&kAgeMask) != age || !fless(Decode(d), g))
+			Store(bucket[0], key, data);
+		else
+			Store(bucket[1], key, data);
+		return false;
+	}
+private:
+	static const uint64_t kAgeMask = 0xFFFF;
+	struct entry {
+		std::atomic<uint64_t> check; // key ^ data
+		std::atomic<uint64_t> data; // g with the iteration in the low 16 bits
+	};
+	inline uint64_t Encode(double g) const
+	{
+		uint64_t bits;
+		memcpy(&bits, &g, sizeof(bits));
+		return (bits&~kAgeMask)|age;
+	}
+	static inline double Decode(uint64_t data)
+	{
+		double g;
+		data &= ~kAgeMask;
+		memcpy(&g, &data, sizeof(g));
+		return g;
+	}
+	static inline void Store(entry &e, uint64_t key, uint64_t data)
+	{
+		e.check.store(key^data, std::memory_order_relaxed);
+		e.data.store(data, std::memory_order_relaxed);
+	}
+	std::unique_ptr<entry[]> entries;
+	size_t mask;
+	uint64_t age;
+};
+
+#endif
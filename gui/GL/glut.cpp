@@ -16,10 +16,6 @@ void glutInitDisplayMode (unsigned int mode) {};
 void glutInitWindowPosition (int x, int y) {};
 void glutInitWindowSize (int width, int height) {};
 void glutKeyboardFunc (void (*) (unsigned char key, int x, int y)) {};
-void glutMainLoop (void) { 
-	while (1)
-		renderScene();
-};
 void glutSetCursor(int cursor){}
 void glutPassiveMotionFunc(void (*func)(int x, int y)) {};
 void glutWarpPointer(int x, int y){};
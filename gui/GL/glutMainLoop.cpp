@@ -0,0 +1,8 @@
+#include "glut.h"
+
+// Kept out of glut.cpp so that programs which only draw through the stubs,
+// and have no window, do not have to define renderScene.
+void glutMainLoop (void) { 
+	while (1)
+		renderScene();
+};
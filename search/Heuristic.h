@@ -9,6 +9,10 @@
 #ifndef hog2_glut_Heuristic_h
 #define hog2_glut_Heuristic_h
 
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <stdint.h>
 #include <vector>
 
 enum HeuristicTreeNodeType {
@@ -24,17 +28,77 @@ struct HeuristicTreeNode
 	unsigned int numChildren;
 };
 
+/**
+ * Counters for the evaluations of Heuristic trees. A thread only records
+ * them after pointing ThreadStats() at its own object, so several threads
+ * can share one heuristic without writing to shared memory.
+ */
+struct HeuristicStats {
+	HeuristicStats() { Reset(); }
+	void Reset()
+	{
+		evaluations = leafLookups = shortCircuits = 0;
+		for (int x = 0; x < 256; x++)
+			histogram[x] = 0;
+	}
+	void Add(const HeuristicStats &s)
+	{
+		evaluations += s.evaluations;
+		leafLookups += s.leafLookups;
+		shortCircuits += s.shortCircuits;
+		for (int x = 0; x < 256; x++)
+			histogram[x] += s.histogram[x];
+	}
+	/** Stats of the calling thread; 0 (the default) records nothing. */
+	static HeuristicStats *&ThreadStats()
+	{
+		static thread_local HeuristicStats *stats = 0;
+		return stats;
+	}
+	uint64_t evaluations; // trees evaluated
+	uint64_t leafLookups; // leaf heuristics evaluated
+	uint64_t shortCircuits; // max nodes that skipped children because of the bound
+	uint64_t histogram[256]; // values returned by the trees, capped at 255
+};
+
+// deepest HeuristicTreeNode tree that can be evaluated
+const int kMaxHeuristicTreeDepth = 32;
+// states evaluated together by the batch lookups of a tree
+const size_t kHeuristicBatch = 64;
+
 template <class state>
 class Heuristic {
 public:
-	Heuristic() { for (int x = 0; x < 256; x++) histogram[x] = 0; }
 	virtual ~Heuristic() {}
 	virtual double HCost(const state &a, const state &b) const;
+	/**
+	 * h(a, b) if it is at most bound, otherwise any value in (bound, h(a, b)],
+	 * for callers that only compare h against bound. Subclasses that override
+	 * HCost and can stop early should override this too; by default it calls
+	 * HCost, or evaluates the lookups tree with the bound if there is one.
+	 */
+	virtual double HCostBounded(const state &a, const state &b, double bound) const;
+	bool HCostExceeds(const state &a, const state &b, double bound) const
+	{ return HCostBounded(a, b, bound) > bound; }
+	/**
+	 * h(states[x], b) for each of the n states, written to out. Evaluating
+	 * the successors of a node together lets subclasses that read large
+	 * tables overlap their cache misses. By default each state is evaluated
+	 * with HCost, or the lookups tree is evaluated one leaf at a time for
+	 * the whole batch.
+	 */
+	virtual void BatchHCost(const state *states, size_t n, const state &b, double *out) const;
+	/**
+	 * Evaluate the lookups tree. Max nodes reached from the root through max
+	 * nodes only stop evaluating children once their value exceeds bound; the
+	 * result is then still a lower bound on the full value and above bound.
+	 * Their leaves are evaluated with HCostBounded.
+	 */
+	double TreeHCost(const state &a, const state &b, double bound = DBL_MAX) const;
 	std::vector<HeuristicTreeNode> lookups;
 	std::vector<Heuristic*> heuristics;
-	mutable uint64_t histogram[256];
 private:
-	double HCost(const state &s1, const state &s2, int treeNode) const;
+	void TreeBatchHCost(unsigned int node, const state *states, size_t n, const state &b, double *out) const;
 };
 
 template <class state>
@@ -48,44 +112,184 @@ class WeightedHeuristic : public Heuristic<state> {
 public:
 	WeightedHeuristic(Heuristic<state> *h, double weight) :h(h), weight(weight){}
 	double HCost(const state &a, const state &b) const { return weight*h->HCost(a, b); }
+	double HCostBounded(const state &a, const state &b, double bound) const
+	{ return (weight > 0)?weight*h->HCostBounded(a, b, bound/weight):HCost(a, b); }
 private:
 	Heuristic<state> *h;
 	double weight;
 };
 
 
+/**
+ * h->HCostBounded(a, b, bound) if the heuristic class has HCostBounded and
+ * h->HCost(a, b) otherwise, for searches templated on the heuristic class.
+ */
+template <class heuristic, class state>
+inline auto BoundedHCostImpl(const heuristic *h, const state &a, const state &b, double bound, int)
+-> decltype(h->HCostBounded(a, b, bound))
+{ return h->HCostBounded(a, b, bound); }
+
+template <class heuristic, class state>
+inline double BoundedHCostImpl(const heuristic *h, const state &a, const state &b, double, long)
+{ return h->HCost(a, b); }
+
+template <class heuristic, class state>
+inline double BoundedHCost(const heuristic *h, const state &a, const state &b, double bound)
+{ return BoundedHCostImpl(h, a, b, bound, 0); }
+
+/**
+ * h->BatchHCost(states, n, b, out) if the heuristic class has BatchHCost and
+ * h->HCost for each state otherwise.
+ */
+template <class heuristic, class state>
+inline auto BatchedHCostImpl(const heuristic *h, const state *states, size_t n, const state &b, double *out, int)
+-> decltype(h->BatchHCost(states, n, b, out))
+{ h->BatchHCost(states, n, b, out); }
+
+template <class heuristic, class state>
+inline void BatchedHCostImpl(const heuristic *h, const state *states, size_t n, const state &b, double *out, long)
+{
+	for (size_t x = 0; x < n; x++)
+		out[x] = h->HCost(states[x], b);
+}
+
+template <class heuristic, class state>
+inline void BatchedHCost(const heuristic *h, const state *states, size_t n, const state &b, double *out)
+{ BatchedHCostImpl(h, states, n, b, out, 0); }
+
 template <class state>
 double Heuristic<state>::HCost(const state &s1, const state &s2) const
 {
-	return HCost(s1, s2, 0);
+	return TreeHCost(s1, s2);
+}
+
+template <class state>
+double Heuristic<state>::HCostBounded(const state &s1, const state &s2, double bound) const
+{
+	if (lookups.size() == 0)
+		return HCost(s1, s2);
+	return TreeHCost(s1, s2, bound);
+}
+
+template <class state>
+void Heuristic<state>::BatchHCost(const state *states, size_t n, const state &b, double *out) const
+{
+	if (lookups.size() == 0)
+	{
+		for (size_t x = 0; x < n; x++)
+			out[x] = HCost(states[x], b);
+		return;
+	}
+	for (size_t x = 0; x < n; x += kHeuristicBatch)
+		TreeBatchHCost(0, states+x, std::min(n-x, kHeuristicBatch), b, out+x);
+	if (HeuristicStats *stats = HeuristicStats::ThreadStats())
+	{
+		stats->evaluations += n;
+		for (size_t x = 0; x < n; x++)
+			stats->histogram[std::min(255, std::max(0, (int)out[x]))]++;
+	}
+}
+
+/** Evaluate the subtree at node for at most kHeuristicBatch states. */
+template <class state>
+void Heuristic<state>::TreeBatchHCost(unsigned int node, const state *states, size_t n, const state &b, double *out) const
+{
+	assert(node < lookups.size() && n <= kHeuristicBatch);
+	const HeuristicTreeNode &t = lookups[node];
+	if (t.nodeType == kLeafNode)
+	{
+		heuristics[t.whichNode]->BatchHCost(states, n, b, out);
+		if (HeuristicStats *stats = HeuristicStats::ThreadStats())
+			stats->leafLookups += n;
+		return;
+	}
+	std::fill(out, out+n, 0.0);
+	double child[kHeuristicBatch];
+	for (unsigned int c = 0; c < t.numChildren; c++)
+	{
+		TreeBatchHCost(t.whichNode+c, states, n, b, child);
+		for (size_t x = 0; x < n; x++)
+		{
+			if (t.nodeType == kMaxNode)
+				out[x] = std::max(out[x], child[x]);
+			else
+				out[x] += child[x];
+		}
+	}
 }
 
+/**
+ * Walks the tree with an explicit stack instead of recursing. The object is
+ * only read, so one heuristic can be evaluated by several threads at once.
+ */
 template <class state>
-double Heuristic<state>::HCost(const state &s1, const state &s2, int treeNode) const
+double Heuristic<state>::TreeHCost(const state &s1, const state &s2, double bound) const
 {
+	struct frame {
+		const HeuristicTreeNode *node;
+		unsigned int next; // child being evaluated
+		double value;
+		bool bounded; // may stop early once value > bound
+	};
+	frame stack[kMaxHeuristicTreeDepth];
+	int depth = 0;
+	uint64_t leaves = 0, cuts = 0;
+	unsigned int current = 0;
+	bool bounded = (bound < DBL_MAX);
 	double hval = 0;
-	switch (lookups[treeNode].nodeType)
+	while (true)
 	{
-		case kMaxNode:
+		assert(current < lookups.size());
+		const HeuristicTreeNode &n = lookups[current];
+		if (n.nodeType != kLeafNode && n.numChildren > 0)
 		{
-			for (int x = 0; x < lookups[treeNode].numChildren; x++)
-			{
-				hval = std::max(hval, HCost(s1, s2, lookups[treeNode].whichNode+x));
-			}
-		} break;
-		case kAddNode:
+			assert(depth < kMaxHeuristicTreeDepth);
+			bounded = bounded && (n.nodeType == kMaxNode);
+			stack[depth++] = {&n, 0, 0, bounded};
+			current = n.whichNode;
+			continue;
+		}
+		if (n.nodeType == kLeafNode)
+		{
+			if (bounded)
+				hval = heuristics[n.whichNode]->HCostBounded(s1, s2, bound);
+			else
+				hval = heuristics[n.whichNode]->HCost(s1, s2);
+			leaves++;
+		}
+		else {
+			hval = 0;
+		}
+		// fold finished subtrees into their parents until one has children left
+		while (depth > 0)
 		{
-			for (int x = 0; x < lookups[treeNode].numChildren; x++)
+			frame &f = stack[depth-1];
+			if (f.node->nodeType == kMaxNode)
+				f.value = std::max(f.value, hval);
+			else
+				f.value += hval;
+			f.next++;
+			if (f.next < f.node->numChildren)
 			{
-				hval += HCost(s1, s2, lookups[treeNode].whichNode+x);
+				if (!(f.bounded && f.value > bound))
+					break;
+				cuts++;
 			}
-		} break;
-		case kLeafNode:
-		{
-			hval = heuristics[lookups[treeNode].whichNode]->HCost(s1, s2);
-		} break;
+			hval = f.value;
+			depth--;
+		}
+		if (depth == 0)
+			break;
+		current = stack[depth-1].node->whichNode+stack[depth-1].next;
+		bounded = stack[depth-1].bounded;
+	}
+	if (HeuristicStats *stats = HeuristicStats::ThreadStats())
+	{
+		stats->evaluations++;
+		stats->leafLookups += leaves;
+		stats->shortCircuits += cuts;
+		stats->histogram[std::min(255, std::max(0, (int)hval))]++;
 	}
-//	histogram[int(hval)]++;
 	return hval;
 }
 
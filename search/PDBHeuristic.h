@@ -11,9 +11,13 @@
 
 #include <cassert>
 #include <thread>
+#include <atomic>
+#include <iostream>
 #include <string>
+#include <string.h>
+#include <stdio.h>
 #include "Heuristic.h"
-#include "SharedQueue.h"
+#include "WorkerPool.h"
 #include "NBitArray.h"
 #include "Timer.h"
 #include "RangeCompression.h"
@@ -44,6 +48,7 @@ public:
 	{	GetStateFromPDBHash(this->GetAbstractHash(goal), goalState); goalSet = true; }
 
 	virtual double HCost(const state &a, const state &b) const;
+	virtual void BatchHCost(const state *states, size_t n, const state &b, double *out) const;
 
 	virtual uint64_t GetPDBSize() const = 0;
 
@@ -56,6 +61,14 @@ public:
 	virtual void Save(const char *prefix) = 0;
 	virtual bool Load(FILE *f);
 	virtual void Save(FILE *f);
+	/** Write the table in the format read by LoadMapped. */
+	bool SaveMappable(const char *file);
+	/**
+	 * Map a table written by SaveMappable read-only instead of copying it, so
+	 * processes that load the same file share its pages and start without
+	 * reading it. With prefetch the whole table is read in ahead of use.
+	 */
+	bool LoadMapped(const char *file, bool prefetch = false);
 	virtual std::string GetFileName(const char *prefix) = 0;
 	
 	void BuildPDB(const state &goal, int numThreads)
@@ -63,6 +76,7 @@ public:
 	void BuildPDBForward(const state &goal, int numThreads);
 	void BuildPDBBackward(const state &goal, int numThreads);
 	void BuildPDBForwardBackward(const state &goal, int numThreads);
+	bool BuildPDBExternal(const state &goal, const char *workPrefix, const char *outputFile, uint64_t memoryLimit);
 
 	void BuildAdditivePDB(state &goal, const char *pdb_filename, int numThreads);
 
@@ -107,25 +121,37 @@ public:
 	abstractState goalState;
 private:
 	bool goalSet;
-	void ForwardThreadWorker(int threadNum, int depth,
-							 NBitArray<pdbBits> &DB,
-							 std::vector<bool> &coarse,
-							 SharedQueue<std::pair<uint64_t, uint64_t> > *work,
-							 SharedQueue<uint64_t> *results,
-							 std::mutex *lock);
-	void BackwardThreadWorker(int threadNum, int depth,
-							  NBitArray<pdbBits> &DB,
-							  std::vector<bool> &coarse,
-							  SharedQueue<std::pair<uint64_t, uint64_t> > *work,
-							  SharedQueue<uint64_t> *results,
-							  std::mutex *lock);
-	void ForwardBackwardThreadWorker(int threadNum, int depth, bool forward,
-									 NBitArray<pdbBits> &DB,
-									 std::vector<bool> &coarseOpen,
-									 std::vector<bool> &coarseClosed,
-									 SharedQueue<std::pair<uint64_t, uint64_t> > *work,
-									 SharedQueue<uint64_t> *results,
-									 std::mutex *lock);
+	// start of a file written by SaveMappable; followed by the goal, the
+	// value ranges and, at dataOffset, the entries and one spare word
+	struct mappedHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t bits;
+		uint32_t type;
+		uint32_t stateSize;
+		uint64_t compressionValue;
+		uint64_t entries;
+		uint64_t dataOffset; // page aligned
+	};
+	static const uint32_t kMappedVersion = 1;
+	struct writeInfo {
+		uint64_t rank;
+		int newGCost;
+	};
+	// scratch space of one pool thread during a build
+	struct buildScratch {
+		buildScratch(const abstractState &g) :s(g), t(g) {}
+		std::vector<abstractAction> acts;
+		abstractState s, t;
+		std::vector<writeInfo> cache;
+	};
+	uint64_t ForwardChunk(uint64_t start, uint64_t end, int threadNum, int depth,
+						  NBitArray<pdbBits> &DB, buildScratch &scratch,
+						  std::vector<std::atomic<bool>> &coarseOpen,
+						  std::vector<std::atomic<bool>> *coarseClosed);
+	uint64_t BackwardChunk(uint64_t start, uint64_t end, int threadNum, int depth,
+						   NBitArray<pdbBits> &DB, buildScratch &scratch,
+						   std::vector<std::atomic<bool>> &coarseClosed);
 };
 
 template <class abstractState, class abstractAction, class abstractEnvironment, class state, uint64_t pdbBits>
@@ -158,13 +184,51 @@ double PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, p
 	}
 }
 
+/**
+ * Ranks all the states and prefetches their entries before reading any of
+ * them, so the cache misses of the batch overlap instead of following each
+ * other.
+ */
+template <class abstractState, class abstractAction, class abstractEnvironment, class state, uint64_t pdbBits>
+void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::BatchHCost(const state *states, size_t n, const state &b, double *out) const
+{
+	uint64_t index[kHeuristicBatch];
+	for (size_t start = 0; start < n; start += kHeuristicBatch)
+	{
+		size_t count = std::min(n-start, kHeuristicBatch);
+		for (size_t x = 0; x < count; x++)
+		{
+			switch (type)
+			{
+				case kPlain:
+				case kValueCompress:
+					index[x] = GetAbstractHash(states[start+x]);
+					break;
+				case kDivCompress:
+				case kDivPlusValueCompress:
+					index[x] = GetAbstractHash(states[start+x])/compressionValue;
+					break;
+				case kModCompress:
+					index[x] = GetAbstractHash(states[start+x])%compressionValue;
+					break;
+				default:
+					assert(!"Not implemented");
+			}
+			PDB.Prefetch(index[x]);
+		}
+		bool ranges = (type == kValueCompress || type == kDivPlusValueCompress);
+		for (size_t x = 0; x < count; x++)
+		{
+			uint64_t value = PDB.Get(index[x]);
+			out[start+x] = ranges?vrcValues[value]:value;
+		}
+	}
+}
+
 template <class abstractState, class abstractAction, class abstractEnvironment, class state, uint64_t pdbBits>
 void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::BuildPDBForward(const state &goal, int numThreads)
 {
 	assert(goalSet);
-	SharedQueue<std::pair<uint64_t, uint64_t> > workQueue(numThreads*20);
-	SharedQueue<uint64_t> resultQueue;
-	std::mutex lock;
 	
 	uint64_t COUNT = GetPDBSize();
 	PDB.Resize(COUNT);
@@ -172,8 +236,8 @@ void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdb
 	
 	// with weights we have to store the lowest weight stored to make sure
 	// we don't skip regions
-	std::vector<bool> coarseOpenCurr((COUNT+coarseSize-1)/coarseSize);
-	std::vector<bool> coarseOpenNext((COUNT+coarseSize-1)/coarseSize);
+	std::vector<std::atomic<bool>> coarseOpenCurr((COUNT+coarseSize-1)/coarseSize);
+	std::vector<std::atomic<bool>> coarseOpenNext((COUNT+coarseSize-1)/coarseSize);
 	
 	uint64_t entries = 1;
 	std::cout << "Num Entries: " << COUNT << std::endl;
@@ -181,61 +245,37 @@ void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdb
 	//std::cout << "State Hash of Goal: " << GetStateHash(goal) << std::endl;
 	std::cout << "PDB Hash of Goal: " << GetPDBHash(goalState) << std::endl;
 	
-	std::deque<state> q_curr, q_next;
-	std::vector<state> children;
-	
 	Timer t;
 	t.StartTimer();
 	PDB.Set(GetPDBHash(goalState), 0);
 
 	coarseOpenCurr[GetPDBHash(goalState)/coarseSize] = true;
 	int depth = 0;
-	uint64_t newEntries;
-	std::vector<std::thread*> threads(numThreads);
+	// the threads live for the whole build; each layer hands out its chunks
+	// through the pool's atomic task counter
 	printf("Creating %d threads\n", numThreads);
+	WorkerPool pool(numThreads);
+	std::vector<buildScratch> scratch(numThreads, buildScratch(goalState));
+	std::vector<uint64_t> chunks;
 	do {
-		newEntries = 0;
 		Timer s;
 		s.StartTimer();
-		for (int x = 0; x < numThreads; x++)
-		{
-			threads[x] = new std::thread(&PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::ForwardThreadWorker,
-										 this,
-										 x, depth, std::ref(PDB), std::ref(coarseOpenNext),
-										 &workQueue, &resultQueue, &lock);
-		}
-		
+		chunks.resize(0);
 		for (uint64_t x = 0; x < COUNT; x+=coarseSize)
 		{
 			if (coarseOpenCurr[x/coarseSize])
-			{
-				workQueue.WaitAdd({x, std::min(COUNT, x+coarseSize)});
-			}
+				chunks.push_back(x);
 			coarseOpenCurr[x/coarseSize] = false;
 		}
-		for (int x = 0; x < numThreads; x++)
-		{
-			workQueue.WaitAdd({0,0});
-		}
-		for (int x = 0; x < numThreads; x++)
-		{
-			threads[x]->join();
-			delete threads[x];
-			threads[x] = 0;
-		}
-		// read out node counts
-		uint64_t total = 0;
-		{
-			uint64_t val;
-			while (resultQueue.Remove(val))
-			{
-				total+=val;
-			}
-		}
+		std::atomic<uint64_t> total(0);
+		pool.ParallelFor(chunks.size(), [&](size_t x, int threadID) {
+			total += ForwardChunk(chunks[x], std::min(COUNT, chunks[x]+coarseSize), threadID, depth,
+								  PDB, scratch[threadID], coarseOpenNext, 0);
+		});
 		
-		entries += total;//newEntries;
+		entries += total;
 		printf("Depth %d complete; %1.2fs elapsed. %llu new states written; %llu of %llu total\n",
-			   depth, s.EndTimer(), total, entries, COUNT);
+			   depth, s.EndTimer(), total.load(), entries, COUNT);
 		depth++;
 		coarseOpenCurr.swap(coarseOpenNext);
 	} while (entries != COUNT);
@@ -253,9 +293,6 @@ template <class abstractState, class abstractAction, class abstractEnvironment,
 void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::BuildPDBBackward(const state &goal, int numThreads)
 {
 	assert(goalSet);
-	SharedQueue<std::pair<uint64_t, uint64_t> > workQueue(numThreads*20);
-	SharedQueue<uint64_t> resultQueue;
-	std::mutex lock;
 	
 	uint64_t COUNT = GetPDBSize();
 	PDB.Resize(COUNT);
@@ -263,7 +300,7 @@ void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdb
 	
 	// with weights we have to store the lowest weight stored to make sure
 	// we don't skip regions
-	std::vector<bool> coarseClosed((COUNT+coarseSize-1)/coarseSize);
+	std::vector<std::atomic<bool>> coarseClosed((COUNT+coarseSize-1)/coarseSize);
 	
 	uint64_t entries = 1;
 	std::cout << "Num Entries: " << COUNT << std::endl;
@@ -271,58 +308,33 @@ void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdb
 	//std::cout << "State Hash of Goal: " << GetStateHash(goal) << std::endl;
 	std::cout << "PDB Hash of Goal: " << GetPDBHash(goalState) << std::endl;
 	
-	std::deque<state> q_curr, q_next;
-	std::vector<state> children;
-	
 	Timer t;
 	t.StartTimer();
 	PDB.Set(GetPDBHash(goalState), 0);
 	
 	int depth = 0;
-	uint64_t newEntries;
-	std::vector<std::thread*> threads(numThreads);
 	printf("Creating %d threads\n", numThreads);
+	WorkerPool pool(numThreads);
+	std::vector<buildScratch> scratch(numThreads, buildScratch(goalState));
+	std::vector<uint64_t> chunks;
 	do {
-		newEntries = 0;
 		Timer s;
 		s.StartTimer();
-		for (int x = 0; x < numThreads; x++)
-		{
-			threads[x] = new std::thread(&PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::BackwardThreadWorker,
-										 this,
-										 x, depth, std::ref(PDB), std::ref(coarseClosed),
-										 &workQueue, &resultQueue, &lock);
-		}
+		chunks.resize(0);
 		for (uint64_t x = 0; x < COUNT; x+=coarseSize)
 		{
 			if (coarseClosed[x/coarseSize] == false)
-			{
-				workQueue.WaitAdd({x, std::min(COUNT, x+coarseSize)});
-			}
-		}
-		for (int x = 0; x < numThreads; x++)
-		{
-			workQueue.WaitAdd({0,0});
-		}
-		for (int x = 0; x < numThreads; x++)
-		{
-			threads[x]->join();
-			delete threads[x];
-			threads[x] = 0;
-		}
-		// read out node counts
-		uint64_t total = 0;
-		{
-			uint64_t val;
-			while (resultQueue.Remove(val))
-			{
-				total+=val;
-			}
+				chunks.push_back(x);
 		}
+		std::atomic<uint64_t> total(0);
+		pool.ParallelFor(chunks.size(), [&](size_t x, int threadID) {
+			total += BackwardChunk(chunks[x], std::min(COUNT, chunks[x]+coarseSize), threadID, depth,
+								   PDB, scratch[threadID], coarseClosed);
+		});
 		
-		entries += total;//newEntries;
+		entries += total;
 		printf("Depth %d complete; %1.2fs elapsed. %llu new states written; %llu of %llu total\n",
-			   depth, s.EndTimer(), total, entries, COUNT);
+			   depth, s.EndTimer(), total.load(), entries, COUNT);
 		depth++;
 	} while (entries != COUNT);
 	
@@ -339,9 +351,6 @@ template <class abstractState, class abstractAction, class abstractEnvironment,
 void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::BuildPDBForwardBackward(const state &goal, int numThreads)
 {
 	assert(goalSet);
-	SharedQueue<std::pair<uint64_t, uint64_t> > workQueue(numThreads*20);
-	SharedQueue<uint64_t> resultQueue;
-	std::mutex lock;
 	
 	uint64_t COUNT = GetPDBSize();
 	PDB.Resize(COUNT);
@@ -349,9 +358,9 @@ void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdb
 	
 	// with weights we have to store the lowest weight stored to make sure
 	// we don't skip regions
-	std::vector<bool> coarseClosed((COUNT+coarseSize-1)/coarseSize);
-	std::vector<bool> coarseOpenCurr((COUNT+coarseSize-1)/coarseSize);
-	std::vector<bool> coarseOpenNext((COUNT+coarseSize-1)/coarseSize);
+	std::vector<std::atomic<bool>> coarseClosed((COUNT+coarseSize-1)/coarseSize);
+	std::vector<std::atomic<bool>> coarseOpenCurr((COUNT+coarseSize-1)/coarseSize);
+	std::vector<std::atomic<bool>> coarseOpenNext((COUNT+coarseSize-1)/coarseSize);
 	
 	uint64_t entries = 1;
 	std::cout << "Num Entries: " << COUNT << std::endl;
@@ -359,8 +368,6 @@ void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdb
 	//std::cout << "State Hash of Goal: " << GetStateHash(goal) << std::endl;
 	std::cout << "PDB Hash of Goal: " << GetPDBHash(goalState) << std::endl;
 	
-	std::deque<state> q_curr, q_next;
-	std::vector<state> children;
 	std::vector<uint64_t> distribution;
 
 	Timer t;
@@ -370,66 +377,45 @@ void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdb
 	distribution.push_back(1);
 	
 	int depth = 0;
-	uint64_t newEntries;
 	bool searchForward = true;
-	std::vector<std::thread*> threads(numThreads);
 	printf("Creating %d threads\n", numThreads);
+	WorkerPool pool(numThreads);
+	std::vector<buildScratch> scratch(numThreads, buildScratch(goalState));
+	std::vector<uint64_t> chunks;
 	do {
-		newEntries = 0;
 		Timer s;
 		s.StartTimer();
-		for (int x = 0; x < numThreads; x++)
-		{
-			threads[x] = new std::thread(&PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::ForwardBackwardThreadWorker,
-										 this,
-										 x, depth, searchForward,
-										 std::ref(PDB), std::ref(coarseOpenNext), std::ref(coarseClosed),
-										 &workQueue, &resultQueue, &lock);
-		}
+		chunks.resize(0);
+		std::atomic<uint64_t> total(0);
 		if (searchForward)
 		{
 			for (uint64_t x = 0; x < COUNT; x+=coarseSize)
 			{
 				if (coarseOpenCurr[x/coarseSize])
-				{
-					workQueue.WaitAdd({x, std::min(COUNT, x+coarseSize)});
-				}
+					chunks.push_back(x);
 				coarseOpenCurr[x/coarseSize] = false;
 			}
+			pool.ParallelFor(chunks.size(), [&](size_t x, int threadID) {
+				total += ForwardChunk(chunks[x], std::min(COUNT, chunks[x]+coarseSize), threadID, depth,
+									  PDB, scratch[threadID], coarseOpenNext, &coarseClosed);
+			});
 		}
 		else {
 			for (uint64_t x = 0; x < COUNT; x+=coarseSize)
 			{
 				if (coarseClosed[x/coarseSize] == false)
-				{
-					workQueue.WaitAdd({x, std::min(COUNT, x+coarseSize)});
-				}
+					chunks.push_back(x);
 			}
+			pool.ParallelFor(chunks.size(), [&](size_t x, int threadID) {
+				total += BackwardChunk(chunks[x], std::min(COUNT, chunks[x]+coarseSize), threadID, depth,
+									   PDB, scratch[threadID], coarseClosed);
+			});
 		}
 
-		for (int x = 0; x < numThreads; x++)
-		{
-			workQueue.WaitAdd({0,0});
-		}
-		for (int x = 0; x < numThreads; x++)
-		{
-			threads[x]->join();
-			delete threads[x];
-			threads[x] = 0;
-		}
-		// read out node counts
-		uint64_t total = 0;
-		{
-			uint64_t val;
-			while (resultQueue.Remove(val))
-			{
-				total+=val;
-			}
-		}
-		entries += total;//newEntries;
+		entries += total;
 		distribution.push_back(total);
 		printf("Depth %d complete; %1.2fs elapsed. %llu new states written; %llu of %llu total [%s]\n",
-			   depth, s.EndTimer(), total, entries, COUNT, searchForward?"forward":"backward");
+			   depth, s.EndTimer(), total.load(), entries, COUNT, searchForward?"forward":"backward");
 		if (double(total)*double(total)*0.4 > double(COUNT-entries)*double(distribution[distribution.size()-2]))// || depth == 8)
 			searchForward = false;
 		if (COUNT-entries <= total) // If we wrote more entries than there are left, switch directions
@@ -447,290 +433,385 @@ void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdb
 	PrintHistogram();
 }
 
-
+/**
+ * Expand the states of [start, end) at the given depth and lower the entries
+ * of their successors. Marks the chunks of the successors in coarseOpen, and
+ * this chunk in coarseClosed (if given) once all of its entries are written.
+ * Returns the number of entries lowered.
+ */
 template <class abstractState, class abstractAction, class abstractEnvironment, class state, uint64_t pdbBits>
-void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::ForwardThreadWorker(int threadNum, int depth,
-																	 NBitArray<pdbBits> &DB,
-																	 std::vector<bool> &coarse,
-																	 SharedQueue<std::pair<uint64_t, uint64_t> > *work,
-																	 SharedQueue<uint64_t> *results,
-																	 std::mutex *lock)
+uint64_t PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::ForwardChunk(uint64_t start, uint64_t end, int threadNum, int depth,
+																									  NBitArray<pdbBits> &DB, buildScratch &scratch,
+																									  std::vector<std::atomic<bool>> &coarseOpen,
+																									  std::vector<std::atomic<bool>> *coarseClosed)
 {
-//	lock->lock();
-//	printf("Thread %d online\n", threadNum);
-//	lock->unlock();
-
-	std::pair<uint64_t, uint64_t> p;
-	uint64_t start, end;
-	std::vector<abstractAction> acts;
-	abstractState s(goalState), t(goalState);
+	std::vector<abstractAction> &acts = scratch.acts;
+	abstractState &s = scratch.s, &t = scratch.t;
+	std::vector<writeInfo> &cache = scratch.cache;
 	uint64_t count = 0;
-	
-	struct writeInfo {
-		uint64_t rank;
-		int newGCost;
-	};
-	std::vector<writeInfo> cache;
-	while (true)
+	bool allEntriesWritten = true;
+	for (uint64_t x = start; x < end; x++)
 	{
-		work->WaitRemove(p);
-		if (p.first == p.second)
+		int stateDepth = DB.Get(x);
+		if (stateDepth > depth)
+			allEntriesWritten = false;
+		if (stateDepth == depth)
 		{
-			break;
-		}
-		start = p.first;
-		end = p.second;
-		//int nextDepth = 255;
-		for (uint64_t x = start; x < end; x++)
-		{
-			int stateDepth = DB.Get(x);
-			if (stateDepth == depth)
+			GetStateFromPDBHash(x, s, threadNum);
+			//std::cout << "Expanding[r][" << stateDepth << "]: " << s << std::endl;
+			env->GetActions(s, acts);
+			for (int y = 0; y < acts.size(); y++)
 			{
-				GetStateFromPDBHash(x, s, threadNum);
-				//std::cout << "Expanding[r][" << stateDepth << "]: " << s << std::endl;
-				env->GetActions(s, acts);
-				for (int y = 0; y < acts.size(); y++)
-				{
-					env->GetNextState(s, acts[y], t);
-					assert(env->InvertAction(acts[y]) == true);
-					//virtual bool InvertAction(action &a) const = 0;
-					
-					uint64_t nextRank = GetPDBHash(t, threadNum);
-					int newCost = stateDepth+(env->GCost(t, acts[y]));
-					cache.push_back({nextRank, newCost});
-				}
+				env->GetNextState(s, acts[y], t);
+				assert(env->InvertAction(acts[y]) == true);
+				//virtual bool InvertAction(action &a) const = 0;
+				
+				uint64_t nextRank = GetPDBHash(t, threadNum);
+				int newCost = stateDepth+(env->GCost(t, acts[y]));
+				cache.push_back({nextRank, newCost});
 			}
 		}
-		// write out everything
-		lock->lock();
-		for (auto d : cache)
+	}
+	// write out everything; other threads may write the same entries
+	if (coarseClosed && allEntriesWritten)
+		(*coarseClosed)[start/coarseSize] = true;
+	for (auto d : cache)
+	{
+		if (DB.SetMin(d.rank, d.newGCost)) // shorter path
 		{
-			if (d.newGCost < DB.Get(d.rank)) // shorter path
-			{
-				count++;
-				coarse[d.rank/coarseSize] = true;
-				DB.Set(d.rank, d.newGCost);
-			}
+			count++;
+			coarseOpen[d.rank/coarseSize] = true;
 		}
-		lock->unlock();
-		cache.resize(0);
 	}
-	results->Add(count);
-//	lock->lock();
-//	printf("Thread %d offline\n", threadNum);
-//	lock->unlock();
+	cache.resize(0);
+	return count;
 }
 
+/**
+ * Give each unwritten state of [start, end) that has a successor at the given
+ * depth its cost. Marks this chunk in coarseClosed once no unwritten states
+ * remain. Returns the number of entries written.
+ */
 template <class abstractState, class abstractAction, class abstractEnvironment, class state, uint64_t pdbBits>
-void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::BackwardThreadWorker(int threadNum, int depth,
-																											NBitArray<pdbBits> &DB,
-																											std::vector<bool> &coarse,
-																											SharedQueue<std::pair<uint64_t, uint64_t> > *work,
-																											SharedQueue<uint64_t> *results,
-																											std::mutex *lock)
+uint64_t PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::BackwardChunk(uint64_t start, uint64_t end, int threadNum, int depth,
+																									   NBitArray<pdbBits> &DB, buildScratch &scratch,
+																									   std::vector<std::atomic<bool>> &coarseClosed)
 {
-	std::pair<uint64_t, uint64_t> p;
-	uint64_t start, end;
-	std::vector<abstractAction> acts;
-	abstractState s(goalState), t(goalState);
+	std::vector<abstractAction> &acts = scratch.acts;
+	abstractState &s = scratch.s, &t = scratch.t;
+	std::vector<writeInfo> &cache = scratch.cache;
 	uint64_t count = 0;
 	int blankEntries = 0;
-	struct writeInfo {
-		uint64_t rank;
-		int newGCost;
-	};
-	std::vector<writeInfo> cache;
-	while (true)
+	for (uint64_t x = start; x < end; x++)
 	{
-		work->WaitRemove(p);
-		if (p.first == p.second)
-		{
-			break;
-		}
-		start = p.first;
-		end = p.second;
-		//int nextDepth = 255;
-		blankEntries = 0;
-		for (uint64_t x = start; x < end; x++)
+		int stateDepth = DB.Get(x);
+		if (stateDepth == ((1<<pdbBits)-1))//depth) // pdbBits
 		{
-			int stateDepth = DB.Get(x);
-			if (stateDepth == ((1<<pdbBits)-1))//depth) // pdbBits
+			blankEntries++;
+			GetStateFromPDBHash(x, s, threadNum);
+			//std::cout << "Expanding[r][" << stateDepth << "]: " << s << std::endl;
+			env->GetActions(s, acts);
+			for (int y = 0; y < acts.size(); y++)
 			{
-				blankEntries++;
-				GetStateFromPDBHash(x, s, threadNum);
-				//std::cout << "Expanding[r][" << stateDepth << "]: " << s << std::endl;
-				env->GetActions(s, acts);
-				for (int y = 0; y < acts.size(); y++)
-				{
-					env->GetNextState(s, acts[y], t);
-					//assert(env->InvertAction(acts[y]) == true);
-					//virtual bool InvertAction(action &a) const = 0;
+				env->GetNextState(s, acts[y], t);
+				//assert(env->InvertAction(acts[y]) == true);
+				//virtual bool InvertAction(action &a) const = 0;
 
-					uint64_t nextRank = GetPDBHash(t, threadNum);
-					if (DB.Get(nextRank) == depth)
-					{
-						int newCost = depth+(env->GCost(t, acts[y]));
-						cache.push_back({x, newCost});
-						blankEntries--;
-						break;
-					}
+				uint64_t nextRank = GetPDBHash(t, threadNum);
+				if (DB.Get(nextRank) == depth)
+				{
+					int newCost = depth+(env->GCost(t, acts[y]));
+					cache.push_back({x, newCost});
+					blankEntries--;
+					break;
 				}
 			}
 		}
-		// write out everything
-		if (cache.size() > 0)
+	}
+	// write out everything
+	if (cache.size() > 0)
+	{
+		//printf("%d items to write\n", cache.size());
+		if (blankEntries == 0)
+			coarseClosed[start/coarseSize] = true; // closed
+		// only this thread writes these ranks, but neighbouring ranks may share words
+		for (auto d : cache)
 		{
-			//printf("%d items to write\n", cache.size());
-			lock->lock();
-			if (blankEntries == 0)
-				coarse[start/coarseSize] = true; // closed
-			for (auto d : cache)
-			{
-				if (d.newGCost < DB.Get(d.rank)) // shorter path
-				{
-					count++;
-					DB.Set(d.rank, d.newGCost);
-				}
-			}
-			lock->unlock();
+			if (DB.SetMin(d.rank, d.newGCost)) // shorter path
+				count++;
 		}
-		cache.resize(0);
 	}
-	results->Add(count);
+	cache.resize(0);
+	return count;
 }
 
+/**
+ * Breadth-first build for tables that do not fit in memory. The table is
+ * split into buckets of consecutive ranks, each kept on disk as a slice file
+ * of packed entries; only one slice is in memory at a time. Each depth takes
+ * two sequential passes over the buckets:
+ *  1. expand: read every slice with states at the current depth, and append
+ *     the ranks of their successors (as offsets within the successor's
+ *     bucket) to that bucket's file of candidates;
+ *  2. merge: read each bucket's slice and candidates and give every
+ *     candidate that is still unwritten the next depth. Duplicates are
+ *     removed here, against the whole slice, instead of during expansion.
+ * Progress is saved after the expand pass and after each merged bucket, and
+ * files are replaced by renaming, so a build that is interrupted resumes
+ * where it stopped when called again with the same prefix. Edge costs must
+ * be 1. The finished table is written to outputFile in the format of
+ * Save(FILE *), so it can be read back with Load(FILE *), and the work files
+ * are removed. memoryLimit bounds the size of a slice plus the candidate
+ * buffers. Returns false on an I/O error.
+ */
 template <class abstractState, class abstractAction, class abstractEnvironment, class state, uint64_t pdbBits>
-void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::ForwardBackwardThreadWorker(int threadNum, int depth, bool forward,
-																												   NBitArray<pdbBits> &DB,
-																												   std::vector<bool> &coarseOpen,
-																												   std::vector<bool> &coarseClosed,
-																												   SharedQueue<std::pair<uint64_t, uint64_t> > *work,
-																												   SharedQueue<uint64_t> *results,
-																												   std::mutex *lock)
+bool PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::BuildPDBExternal(const state &goal, const char *workPrefix,
+																										const char *outputFile, uint64_t memoryLimit)
 {
-	std::pair<uint64_t, uint64_t> p;
-	uint64_t start, end;
-	std::vector<abstractAction> acts;
-	abstractState s(goalState), t(goalState);
-	uint64_t count = 0;
-	int blankEntries = 0;
-	struct writeInfo {
-		uint64_t rank;
-		int newGCost;
+	assert(goalSet);
+	const uint64_t COUNT = GetPDBSize();
+	const uint64_t maxValue = (1ull<<pdbBits)-1;
+
+	// half of the memory holds a slice, the other half the candidate buffers;
+	// buckets are whole words so that the slices concatenate into the table
+	uint64_t bucketSize = 64;
+	while (bucketSize < COUNT && bucketSize < (1ull<<32) && 2*bucketSize*pdbBits/8 <= memoryLimit/2)
+		bucketSize *= 2;
+	const uint64_t numBuckets = (COUNT+bucketSize-1)/bucketSize;
+	const uint64_t bufferEntries = std::max<uint64_t>(256, memoryLimit/2/sizeof(uint32_t)/numBuckets);
+
+	// what is stored in the progress file
+	struct buildHeader {
+		char magic[8];
+		uint64_t bits, count, bucketSize;
+		uint64_t depth;
+		uint64_t phase; // 0: expand depth; 1: merge, next is the bucket to merge
+		uint64_t next, entries;
+	} h;
+	const char buildMagic[8] = {'H', 'O', 'G', 'X', 'P', 'D', 'B', '1'};
+	// frontier: states at depth per bucket; written: states at depth+1 per merged bucket
+	std::vector<uint64_t> frontier(numBuckets), written(numBuckets);
+	uint64_t bytesRead = 0, bytesWritten = 0;
+
+	auto fileName = [workPrefix](const char *kind, uint64_t bucket) {
+		return std::string(workPrefix)+"-"+kind+"-"+std::to_string(bucket);
+	};
+	auto saveProgress = [&]() {
+		std::string name = std::string(workPrefix)+"-progress";
+		FILE *f = fopen((name+".tmp").c_str(), "wb");
+		if (f == 0)
+			return false;
+		bool ok = (fwrite(&h, sizeof(h), 1, f) == 1 &&
+				   fwrite(&frontier[0], sizeof(uint64_t), numBuckets, f) == numBuckets &&
+				   fwrite(&written[0], sizeof(uint64_t), numBuckets, f) == numBuckets);
+		ok = (fclose(f) == 0) && ok;
+		return ok && rename((name+".tmp").c_str(), name.c_str()) == 0;
+	};
+	auto loadProgress = [&]() {
+		FILE *f = fopen((std::string(workPrefix)+"-progress").c_str(), "rb");
+		if (f == 0)
+			return false;
+		bool ok = (fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, buildMagic, sizeof(h.magic)) == 0 &&
+				   h.bits == pdbBits && h.count == COUNT && h.bucketSize == bucketSize &&
+				   fread(&frontier[0], sizeof(uint64_t), numBuckets, f) == numBuckets &&
+				   fread(&written[0], sizeof(uint64_t), numBuckets, f) == numBuckets);
+		fclose(f);
+		return ok;
+	};
+	auto readSlice = [&](uint64_t bucket, NBitArray<pdbBits> &slice) {
+		slice.Resize(std::min(bucketSize, COUNT-bucket*bucketSize));
+		FILE *f = fopen(fileName("slice", bucket).c_str(), "rb");
+		if (f == 0)
+			return false;
+		bool ok = (fread(slice.GetMemory(), sizeof(uint64_t), slice.GetMemorySize(), f) == slice.GetMemorySize());
+		fclose(f);
+		bytesRead += slice.GetMemorySize()*sizeof(uint64_t);
+		return ok;
+	};
+	auto writeSlice = [&](uint64_t bucket, NBitArray<pdbBits> &slice) {
+		std::string name = fileName("slice", bucket);
+		FILE *f = fopen((name+".tmp").c_str(), "wb");
+		if (f == 0)
+			return false;
+		bool ok = (fwrite(slice.GetMemory(), sizeof(uint64_t), slice.GetMemorySize(), f) == slice.GetMemorySize());
+		ok = (fclose(f) == 0) && ok;
+		bytesWritten += slice.GetMemorySize()*sizeof(uint64_t);
+		return ok && rename((name+".tmp").c_str(), name.c_str()) == 0;
+	};
+	auto fail = [](const char *what) {
+		printf("External PDB build failed: %s\n", what);
+		return false;
 	};
-	std::vector<writeInfo> cache;
-	if (forward)
+
+	NBitArray<pdbBits> slice;
+	printf("Num Entries: %llu in %llu buckets of %llu\n", (unsigned long long)COUNT, (unsigned long long)numBuckets, (unsigned long long)bucketSize);
+	if (loadProgress())
 	{
-		bool allEntriesWritten;
-		while (true)
+		printf("Resuming %s at depth %llu (%s)\n", workPrefix, (unsigned long long)h.depth, (h.phase == 0)?"expanding":"merging");
+	}
+	else {
+		memcpy(h.magic, buildMagic, sizeof(h.magic));
+		h.bits = pdbBits;
+		h.count = COUNT;
+		h.bucketSize = bucketSize;
+		h.depth = 0;
+		h.phase = 0;
+		h.next = 0;
+		h.entries = 1;
+		uint64_t goalRank = GetPDBHash(goalState);
+		for (uint64_t b = 0; b < numBuckets; b++)
 		{
-			work->WaitRemove(p);
-			if (p.first == p.second)
-			{
-				break;
-			}
-			start = p.first;
-			end = p.second;
-
-			allEntriesWritten = true;
-			for (uint64_t x = start; x < end; x++)
-			{
-				int stateDepth = DB.Get(x);
-				if (stateDepth > depth)
-					allEntriesWritten = false;
-				if (stateDepth == depth)
-				{
-					GetStateFromPDBHash(x, s, threadNum);
-					//std::cout << "Expanding[r][" << stateDepth << "]: " << s << std::endl;
-					env->GetActions(s, acts);
-					for (int y = 0; y < acts.size(); y++)
-					{
-						env->GetNextState(s, acts[y], t);
-						assert(env->InvertAction(acts[y]) == true);
-						//virtual bool InvertAction(action &a) const = 0;
-						
-						uint64_t nextRank = GetPDBHash(t, threadNum);
-						int newCost = stateDepth+(env->GCost(t, acts[y]));
-						cache.push_back({nextRank, newCost});
-					}
-				}
-			}
-			// write out everything
-			lock->lock();
-			if (allEntriesWritten)
-				coarseClosed[start/coarseSize] = true;
-			for (auto d : cache)
-			{
-				if (d.newGCost < DB.Get(d.rank)) // shorter path
-				{
-					count++;
-					coarseOpen[d.rank/coarseSize] = true;
-					DB.Set(d.rank, d.newGCost);
-				}
-			}
-			lock->unlock();
-			cache.resize(0);
+			slice.Resize(std::min(bucketSize, COUNT-b*bucketSize));
+			slice.FillMax();
+			if (b == goalRank/bucketSize)
+				slice.Set(goalRank%bucketSize, 0);
+			if (!writeSlice(b, slice))
+				return fail("cannot write slice");
 		}
+		std::fill(frontier.begin(), frontier.end(), 0);
+		std::fill(written.begin(), written.end(), 0);
+		frontier[goalRank/bucketSize] = 1;
+		if (!saveProgress())
+			return fail("cannot write progress file");
 	}
-	else {
-		while (true)
+
+	Timer t;
+	t.StartTimer();
+	std::vector<std::vector<uint32_t>> buffers(numBuckets);
+	std::vector<abstractAction> acts;
+	abstractState s(goalState), succ(goalState);
+	std::vector<uint32_t> candidates(bufferEntries);
+	while (true)
+	{
+		Timer layer;
+		layer.StartTimer();
+		bytesRead = bytesWritten = 0;
+		if (h.depth+1 >= maxValue)
+			return fail("depth does not fit in the entries");
+		if (h.phase == 0)
 		{
-			work->WaitRemove(p);
-			if (p.first == p.second)
-			{
-				break;
-			}
-			start = p.first;
-			end = p.second;
-			//int nextDepth = 255;
-			blankEntries = 0;
-			for (uint64_t x = start; x < end; x++)
+			// candidates of an interrupted pass are incomplete; start over
+			for (uint64_t b = 0; b < numBuckets; b++)
+				remove(fileName("next", b).c_str());
+			auto flush = [&](uint64_t b) {
+				FILE *f = fopen(fileName("next", b).c_str(), "ab");
+				if (f == 0)
+					return false;
+				bool ok = (fwrite(&buffers[b][0], sizeof(uint32_t), buffers[b].size(), f) == buffers[b].size());
+				ok = (fclose(f) == 0) && ok;
+				bytesWritten += buffers[b].size()*sizeof(uint32_t);
+				buffers[b].resize(0);
+				return ok;
+			};
+			for (uint64_t b = 0; b < numBuckets; b++)
 			{
-				int stateDepth = DB.Get(x);
-				if (stateDepth == ((1<<pdbBits)-1))//depth) // pdbBits
+				if (frontier[b] == 0)
+					continue;
+				if (!readSlice(b, slice))
+					return fail("cannot read slice");
+				for (uint64_t x = 0; x < slice.Size(); x++)
 				{
-					blankEntries++;
-					GetStateFromPDBHash(x, s, threadNum);
-					//std::cout << "Expanding[r][" << stateDepth << "]: " << s << std::endl;
+					if (slice.Get(x) != h.depth)
+						continue;
+					GetStateFromPDBHash(b*bucketSize+x, s);
 					env->GetActions(s, acts);
-					for (int y = 0; y < acts.size(); y++)
+					for (size_t y = 0; y < acts.size(); y++)
 					{
-						env->GetNextState(s, acts[y], t);
-						//assert(env->InvertAction(acts[y]) == true);
-						//virtual bool InvertAction(action &a) const = 0;
-						
-						uint64_t nextRank = GetPDBHash(t, threadNum);
-						if (DB.Get(nextRank) == depth)
-						{
-							int newCost = depth+(env->GCost(t, acts[y]));
-							cache.push_back({x, newCost});
-							blankEntries--;
-							break;
-						}
+						env->GetNextState(s, acts[y], succ);
+						assert(env->GCost(s, acts[y]) == 1);
+						uint64_t rank = GetPDBHash(succ);
+						uint64_t nb = rank/bucketSize;
+						buffers[nb].push_back((uint32_t)(rank%bucketSize));
+						if (buffers[nb].size() >= bufferEntries && !flush(nb))
+							return fail("cannot write candidates");
 					}
 				}
 			}
-			// write out everything
-			if (cache.size() > 0)
+			for (uint64_t b = 0; b < numBuckets; b++)
+				if (buffers[b].size() > 0 && !flush(b))
+					return fail("cannot write candidates");
+			std::fill(written.begin(), written.end(), 0);
+			h.phase = 1;
+			h.next = 0;
+			if (!saveProgress())
+				return fail("cannot write progress file");
+		}
+		// merge; rerunning a bucket gives the same result, so a crash between
+		// writing its slice and saving progress is harmless
+		while (h.next < numBuckets)
+		{
+			uint64_t b = h.next++;
+			FILE *f = fopen(fileName("next", b).c_str(), "rb");
+			if (f == 0)
+				continue; // no candidates
+			if (!readSlice(b, slice))
+				return fail("cannot read slice");
+			size_t count;
+			while ((count = fread(&candidates[0], sizeof(uint32_t), bufferEntries, f)) > 0)
 			{
-				//printf("%d items to write\n", cache.size());
-				lock->lock();
-				if (blankEntries == 0)
-					coarseClosed[start/coarseSize] = true; // closed
-				for (auto d : cache)
-				{
-					if (d.newGCost < DB.Get(d.rank)) // shorter path
-					{
-						count++;
-						DB.Set(d.rank, d.newGCost);
-					}
-				}
-				lock->unlock();
+				bytesRead += count*sizeof(uint32_t);
+				for (size_t x = 0; x < count; x++)
+					if (slice.Get(candidates[x]) == maxValue)
+						slice.Set(candidates[x], h.depth+1);
 			}
-			cache.resize(0);
+			fclose(f);
+			uint64_t newEntries = 0;
+			for (uint64_t x = 0; x < slice.Size(); x++)
+				if (slice.Get(x) == h.depth+1)
+					newEntries++;
+			if (!writeSlice(b, slice))
+				return fail("cannot write slice");
+			written[b] = newEntries;
+			if (!saveProgress())
+				return fail("cannot write progress file");
+			remove(fileName("next", b).c_str());
 		}
+		uint64_t total = 0;
+		for (uint64_t b = 0; b < numBuckets; b++)
+			total += written[b];
+		h.entries += total;
+		double elapsed = layer.EndTimer();
+		printf("Depth %llu complete; %1.2fs elapsed. %llu new states written; %llu of %llu total\n",
+			   (unsigned long long)h.depth, elapsed, (unsigned long long)total, (unsigned long long)h.entries, (unsigned long long)COUNT);
+		printf("Read %1.1f MB (%1.1f MB/s), wrote %1.1f MB (%1.1f MB/s)\n",
+			   bytesRead/1048576.0, bytesRead/1048576.0/std::max(elapsed, 1e-6),
+			   bytesWritten/1048576.0, bytesWritten/1048576.0/std::max(elapsed, 1e-6));
+		frontier.swap(written);
+		std::fill(written.begin(), written.end(), 0);
+		h.depth++;
+		h.phase = 0;
+		h.next = 0;
+		if (!saveProgress())
+			return fail("cannot write progress file");
+		if (total == 0)
+			break;
 	}
-	results->Add(count);
+	if (h.entries != COUNT)
+		printf("Warning: %llu of %llu entries are unreachable\n", (unsigned long long)(COUNT-h.entries), (unsigned long long)COUNT);
+
+	// the table is the concatenation of the slices, in NBitArray's file format
+	FILE *out = fopen(outputFile, "wb");
+	if (out == 0)
+		return fail("cannot write output file");
+	uint64_t words = (COUNT*pdbBits+63)/64;
+	PDBLookupType plain = kPlain;
+	bool ok = (fwrite(&plain, sizeof(plain), 1, out) == 1 &&
+			   fwrite(&goalState, sizeof(goalState), 1, out) == 1 &&
+			   fwrite(&COUNT, sizeof(COUNT), 1, out) == 1 &&
+			   fwrite(&words, sizeof(words), 1, out) == 1);
+	for (uint64_t b = 0; ok && b < numBuckets; b++)
+	{
+		ok = readSlice(b, slice) &&
+			 fwrite(slice.GetMemory(), sizeof(uint64_t), slice.GetMemorySize(), out) == slice.GetMemorySize();
+	}
+	ok = (fclose(out) == 0) && ok;
+	if (!ok)
+		return fail("cannot write output file");
+	for (uint64_t b = 0; b < numBuckets; b++)
+		remove(fileName("slice", b).c_str());
+	remove((std::string(workPrefix)+"-progress").c_str());
+	printf("%1.2fs elapsed; table written to %s\n", t.EndTimer(), outputFile);
+	return true;
 }
 
 template <class abstractState, class abstractAction, class abstractEnvironment, class state, uint64_t pdbBits>
@@ -1134,6 +1215,62 @@ void PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdb
 }
 
 
+template <class abstractState, class abstractAction, class abstractEnvironment, class state, uint64_t pdbBits>
+bool PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::SaveMappable(const char *file)
+{
+	const uint64_t pageSize = 4096;
+	mappedHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "HOGPDB\0\0", sizeof(h.magic));
+	h.version = kMappedVersion;
+	h.bits = pdbBits;
+	h.type = type;
+	h.stateSize = sizeof(goalState);
+	h.compressionValue = compressionValue;
+	h.entries = PDB.Size();
+	uint64_t used = sizeof(h)+sizeof(goalState)+sizeof(vrcValues);
+	h.dataOffset = (used+pageSize-1)/pageSize*pageSize;
+	FILE *f = fopen(file, "wb");
+	if (f == 0)
+	{
+		perror("Could not open file for writing in PDBHeuristic");
+		return false;
+	}
+	std::vector<uint8_t> padding(h.dataOffset-used+sizeof(uint64_t), 0);
+	bool success = (fwrite(&h, sizeof(h), 1, f) == 1 &&
+					fwrite(&goalState, sizeof(goalState), 1, f) == 1 &&
+					fwrite(vrcValues, sizeof(vrcValues), 1, f) == 1 &&
+					fwrite(&padding[0], 1, h.dataOffset-used, f) == h.dataOffset-used &&
+					fwrite(PDB.GetMemory(), sizeof(uint64_t), PDB.GetMemorySize(), f) == PDB.GetMemorySize() &&
+					fwrite(&padding[0], 1, sizeof(uint64_t), f) == sizeof(uint64_t));
+	success = (fclose(f) == 0) && success;
+	return success;
+}
+
+template <class abstractState, class abstractAction, class abstractEnvironment, class state, uint64_t pdbBits>
+bool PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::LoadMapped(const char *file, bool prefetch)
+{
+	mappedHeader h;
+	abstractState g(goalState);
+	int values[1<<pdbBits];
+	FILE *f = fopen(file, "rb");
+	if (f == 0)
+		return false;
+	bool success = (fread(&h, sizeof(h), 1, f) == 1 &&
+					memcmp(h.magic, "HOGPDB\0\0", sizeof(h.magic)) == 0 &&
+					h.version == kMappedVersion && h.bits == pdbBits && h.stateSize == sizeof(goalState) &&
+					fread(&g, sizeof(g), 1, f) == 1 &&
+					fread(values, sizeof(values), 1, f) == 1);
+	fclose(f);
+	if (!success || !PDB.Map(file, h.dataOffset, h.entries, prefetch))
+		return false;
+	type = (PDBLookupType)h.type;
+	compressionValue = h.compressionValue;
+	goalState = g;
+	memcpy(vrcValues, values, sizeof(vrcValues));
+	return true;
+}
+
 template <class abstractState, class abstractAction, class abstractEnvironment, class state, uint64_t pdbBits>
 bool PDBHeuristic<abstractState, abstractAction, abstractEnvironment, state, pdbBits>::Load(FILE *f)
 {
@@ -92,3 +92,34 @@ void CloseMMap(uint8_t *mem, uint64_t mapSizeBytes, int fd)
 		handle_error("close");
 	}
 }
+
+uint8_t *GetReadOnlyMMAP(const char *filename, uint64_t &mapSize, int &fd)
+{
+	struct stat sb;
+	mapSize = 0;
+	if ((fd = open(filename, O_RDONLY)) == -1)
+		return 0;
+	if (fstat(fd, &sb) == -1 || sb.st_size == 0)
+	{
+		close(fd);
+		fd = -1;
+		return 0;
+	}
+	uint8_t *memblock = (uint8_t *)mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (memblock == MAP_FAILED)
+	{
+		close(fd);
+		fd = -1;
+		return 0;
+	}
+	madvise(memblock, sb.st_size, MADV_SEQUENTIAL);
+	mapSize = sb.st_size;
+	return memblock;
+}
+
+void AdviseRandomMMAP(uint8_t *mem, uint64_t mapSize, bool prefetch)
+{
+	madvise(mem, mapSize, MADV_RANDOM);
+	if (prefetch)
+		madvise(mem, mapSize, MADV_WILLNEED);
+}
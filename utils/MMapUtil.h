@@ -11,5 +11,16 @@
 
 uint8_t *GetMMAP(const char *filename, uint64_t mapSizeBytes, int &fd, bool zero = false);
 void CloseMMap(uint8_t *mem, uint64_t mapSizeBytes, int fd);
+/**
+ * Map an existing file read-only for sequential parsing. Unlike GetMMAP this
+ * does not need write access and returns 0 (instead of exiting) if the file
+ * cannot be opened or is empty, so loaders can fall back to stdio.
+ */
+uint8_t *GetReadOnlyMMAP(const char *filename, uint64_t &mapSizeBytes, int &fd);
+/**
+ * Tell the kernel that a mapping is read at random (e.g. a pattern database),
+ * so it does not read ahead; with prefetch, also start reading it all in.
+ */
+void AdviseRandomMMAP(uint8_t *mem, uint64_t mapSizeBytes, bool prefetch);
 
 #endif
@@ -23,7 +23,13 @@
 #include "GLUtil.h"
 #include <cstdlib>
 #include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <string>
+#include <vector>
 #include "BitMap.h"
+#include <sys/stat.h>
+#include "MMapUtil.h"
 
 GLuint wall = -1;
 
@@ -148,6 +154,21 @@ Map::Map(const char *filename)
 	tileSet = kFall;
 }
 
+/**
+* Create a new map by loading it from a file, optionally through a
+* passability cache (see LoadWithPassabilityCache).
+*/
+Map::Map(const char *filename, bool usePassabilityCache)
+{
+	sizeMultiplier = 1;
+	land = 0;
+	if (usePassabilityCache)
+		LoadWithPassabilityCache(filename);
+	else
+		Load(filename);
+	tileSet = kFall;
+}
+
 /** 
 * Create a new map by loading it from a file pointer.
 *
@@ -272,6 +293,11 @@ void Map::Load(const char *filename)
 		land = 0;
 	}
 	revision++;
+	if (tryLoadMMap(filename))
+	{
+		strncpy(map_name, filename, 128);
+		return;
+	}
 	FILE *f = fopen(filename, "r");
 	if (f)
 	{
@@ -383,44 +409,219 @@ void Map::loadOctile(FILE *f, int high, int wide)
 		{
 			char what;
 			fscanf(f, "%c", &what);
-			switch (toupper(what))
+			setOctileTile(x, y, what);
+		}
+			fscanf(f, "\n");
+	}
+}
+
+/**
+* Set the (sizeMultiplier scaled) tiles for one character of an octile map.
+*/
+void Map::setOctileTile(int x, int y, char what)
+{
+	tTerrain type;
+	switch (toupper(what))
+	{
+		case '@':
+		case 'O': type = kOutOfBounds; break;
+		case 'S': type = kSwamp; break;
+		case 'W': type = kWater; break;
+		case 'T': type = kTrees; break;
+		default: type = kGround; break;
+	}
+	for (int r = 0; r < sizeMultiplier; r++)
+		for (int s = 0; s < sizeMultiplier; s++)
+		{
+			Tile &t = land[x*sizeMultiplier+r][y*sizeMultiplier+s];
+			t.tile1.type = t.tile2.type = type;
+			t.tile1.node = kNoGraphNode;
+			t.tile2.node = kNoGraphNode;
+		}
+}
+
+/**
+* Load an octile map by memory-mapping the file and parsing it in one pass.
+* Returns false (without changing the map) for other formats, so that the
+* caller can fall back to the stdio loaders.
+*/
+bool Map::tryLoadMMap(const char *filename)
+{
+	uint64_t size;
+	int fd;
+	uint8_t *mem = GetReadOnlyMMAP(filename, size, fd);
+	if (mem == 0)
+		return false;
+	const char *next = (const char *)mem, *end = next+size;
+
+	// the header is short; parse it from a terminated copy
+	char header[256];
+	size_t headerSize = std::min(size, (uint64_t)sizeof(header)-1);
+	memcpy(header, next, headerSize);
+	header[headerSize] = 0;
+	char format[32];
+	int high, wide, used = 0;
+	int num = sscanf(header, "type %31s\nheight %d\nwidth %d\nmap\n%n", format, &high, &wide, &used);
+	if (num != 3 || used == 0 || strcmp(format, "octile") != 0 || high <= 0 || wide <= 0)
+	{
+		CloseMMap(mem, size, fd);
+		return false;
+	}
+	next += used;
+
+	mapType = kOctile;
+	height = high*sizeMultiplier;
+	width = wide*sizeMultiplier;
+	land = new Tile *[width];
+	for (int x = 0; x < width; x++) land[x] = new Tile [height];
+	drawLand = true;
+	dList = 0;
+	updated = true;
+	for (int y = 0; y < high; y++)
+	{
+		for (int x = 0; x < wide; x++)
+			setOctileTile(x, y, (next < end)?*next++:'@');
+		while (next < end && isspace((unsigned char)*next))
+			next++;
+	}
+	CloseMMap(mem, size, fd);
+	return true;
+}
+
+namespace {
+/** Header of the passability cache written next to a map file. */
+struct passabilityHeader {
+	char magic[4];
+	uint32_t width, height;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+};
+const char passabilityMagic[4] = {'H', 'P', 'B', '1'};
+const char *passabilitySuffix = ".pass";
+}
+
+/**
+* Load a map through a binary passability cache stored in <filename>.pass.
+* The cache holds one bit per cell (ground or swamp vs. anything else) and is
+* rebuilt whenever the map file changes size or modification time. Cells are
+* restored as kGround or kOutOfBounds, so trees and water lose their own
+* terrain type; this is meant for grid benchmarks where only passability for
+* a ground agent matters. Maps that are not octile are loaded normally.
+*/
+void Map::LoadWithPassabilityCache(const char *filename)
+{
+	if (land)
+	{
+		for (int x = 0; x < width; x++)
+			delete [] land[x];
+		delete [] land;
+		land = 0;
+	}
+	revision++;
+	if (sizeMultiplier == 1 && loadPassabilityCache(filename))
+	{
+		strncpy(map_name, filename, 128);
+		return;
+	}
+	Load(filename);
+	if (mapType == kOctile && sizeMultiplier == 1 && land)
+		savePassabilityCache(filename);
+}
+
+bool Map::loadPassabilityCache(const char *filename)
+{
+	struct stat sb;
+	if (stat(filename, &sb) != 0)
+		return false;
+	std::string cacheName = std::string(filename)+passabilitySuffix;
+	uint64_t size;
+	int fd;
+	uint8_t *mem = GetReadOnlyMMAP(cacheName.c_str(), size, fd);
+	if (mem == 0)
+		return false;
+	passabilityHeader h;
+	bool valid = size >= sizeof(h);
+	if (valid)
+	{
+		memcpy(&h, mem, sizeof(h));
+		valid = (memcmp(h.magic, passabilityMagic, 4) == 0 &&
+				 h.sourceSize == (uint64_t)sb.st_size && h.sourceTime == (int64_t)sb.st_mtime &&
+				 h.width > 0 && h.height > 0 &&
+				 size >= sizeof(h)+((uint64_t)h.width*h.height+7)/8);
+	}
+	if (!valid)
+	{
+		CloseMMap(mem, size, fd);
+		return false;
+	}
+	mapType = kOctile;
+	width = h.width;
+	height = h.height;
+	land = new Tile *[width];
+	for (int x = 0; x < width; x++) land[x] = new Tile [height];
+	drawLand = true;
+	dList = 0;
+	updated = true;
+	const uint8_t *bits = mem+sizeof(h);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			uint64_t which = (uint64_t)y*width+x;
+			if (((bits[which>>3]>>(which&7))&1) == 0)
+				land[x][y].tile1.type = land[x][y].tile2.type = kOutOfBounds;
+		}
+	}
+	CloseMMap(mem, size, fd);
+	return true;
+}
+
+/**
+* Write the passability cache for the current map. The file is written under a
+* temporary name and renamed, so concurrent loaders never see a partial cache.
+* Failures (e.g. a read-only map directory) are silently ignored.
+*/
+void Map::savePassabilityCache(const char *filename)
+{
+	struct stat sb;
+	if (stat(filename, &sb) != 0)
+		return;
+	passabilityHeader h;
+	memcpy(h.magic, passabilityMagic, 4);
+	h.width = width;
+	h.height = height;
+	h.sourceSize = sb.st_size;
+	h.sourceTime = sb.st_mtime;
+	std::vector<uint8_t> bits(((uint64_t)width*height+7)/8, 0);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			if ((land[x][y].tile1.type>>terrainBits) == (kGround>>terrainBits))
 			{
-				case '@':
-				case 'O':
-					for (int r = 0; r < sizeMultiplier; r++)
-						for (int s = 0; s < sizeMultiplier; s++)
-							SetTerrainType(x*sizeMultiplier+r, y*sizeMultiplier+s,
-														 kOutOfBounds); break;
-				case 'S':
-					for (int r = 0; r < sizeMultiplier; r++)
-						for (int s = 0; s < sizeMultiplier; s++)
-							SetTerrainType(x*sizeMultiplier+r, y*sizeMultiplier+s,
-														 kSwamp); break;
-				case 'W':
-					for (int r = 0; r < sizeMultiplier; r++)
-						for (int s = 0; s < sizeMultiplier; s++)
-							SetTerrainType(x*sizeMultiplier+r, y*sizeMultiplier+s,
-														 kWater); break;
-				case 'T':
-					for (int r = 0; r < sizeMultiplier; r++)
-						for (int s = 0; s < sizeMultiplier; s++)
-							SetTerrainType(x*sizeMultiplier+r, y*sizeMultiplier+s,
-														 kTrees); break;
-				default:
-					for (int r = 0; r < sizeMultiplier; r++)
-						for (int s = 0; s < sizeMultiplier; s++)
-							SetTerrainType(x*sizeMultiplier+r, y*sizeMultiplier+s,
-														 kGround); break;
+				uint64_t which = (uint64_t)y*width+x;
+				bits[which>>3] |= 1<<(which&7);
 			}
-			for (int r = 0; r < sizeMultiplier; r++)
-				for (int s = 0; s < sizeMultiplier; s++)
-				{
-					land[x*sizeMultiplier+r][y*sizeMultiplier+s].tile1.node = kNoGraphNode;
-					land[x*sizeMultiplier+r][y*sizeMultiplier+s].tile2.node = kNoGraphNode;
-				}
 		}
-			fscanf(f, "\n");
 	}
+	std::string cacheName = std::string(filename)+passabilitySuffix;
+	std::string tmpName = cacheName+".XXXXXX";
+	int fd = mkstemp(&tmpName[0]);
+	if (fd == -1)
+		return;
+	fchmod(fd, 0644);
+	FILE *f = fdopen(fd, "wb");
+	if (f == 0)
+	{
+		close(fd);
+		unlink(tmpName.c_str());
+		return;
+	}
+	bool ok = (fwrite(&h, sizeof(h), 1, f) == 1 &&
+			   fwrite(&bits[0], 1, bits.size(), f) == bits.size());
+	ok = (fclose(f) == 0) && ok;
+	if (!ok || rename(tmpName.c_str(), cacheName.c_str()) != 0)
+		unlink(tmpName.c_str());
 }
 
 void Map::loadOctileCorner(FILE *f, int high, int wide)
@@ -152,12 +152,14 @@ class Map {
 public:
 	Map(long width, long height);
 	Map(const char *filename);
+	Map(const char *filename, bool usePassabilityCache);
 	Map(Map *);
 	Map(FILE *);
 	Map(std::istringstream &data);
 	~Map();
 	void Load(const char *filename);
 	void Load(FILE *f);
+	void LoadWithPassabilityCache(const char *filename);
 	void setSizeMultipler(int _sizeMultiplier)
 	{ sizeMultiplier = _sizeMultiplier; }
 	void Scale(long newWidth, long newHeight);
@@ -237,6 +239,10 @@ private:
 	void loadRaw(FILE *f, int height, int width);
 	void loadOctile(FILE *f, int height, int width);
 	void loadOctileCorner(FILE *f, int height, int width);
+	void setOctileTile(int x, int y, char what);
+	bool tryLoadMMap(const char *filename);
+	bool loadPassabilityCache(const char *filename);
+	void savePassabilityCache(const char *filename);
 	void saveOctile(FILE *f);
 	void saveRaw(FILE *f);
 	bool tryLoadRollingStone(FILE *f);
@@ -12,6 +12,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <algorithm>
+#include <mutex>
+#include "MMapUtil.h"
 
 /**
  * This class supports compact n-bit arrays. For (1 <= n <= 64). 
@@ -33,20 +35,49 @@ public:
 	uint64_t Size() const;
 	uint64_t Get(uint64_t index) const;
 	void Set(uint64_t index, uint64_t val);
+	/**
+	 * Lower the entry to val if it is larger; returns whether it was lowered.
+	 * Safe to call from several threads at once, also on entries that share
+	 * a word. Entries within one word are updated with a compare-and-swap;
+	 * the few that span two words take one of a set of striped locks, and a
+	 * concurrent Get may see such an entry half written.
+	 */
+	bool SetMin(uint64_t index, uint64_t val);
+	/** Start loading the word that holds the entry into the cache. */
+	void Prefetch(uint64_t index) const { __builtin_prefetch(&mem[index*numBits/64]); }
+	/** The packed words, for bulk I/O. */
+	uint64_t *GetMemory() { return mem; }
+	/** Number of 64-bit words used by the entries. */
+	uint64_t GetMemorySize() const { return memorySize; }
 
 	bool Write(FILE *);
 	bool Read(FILE *);
 	bool Write(const char *);
 	bool Read(const char *);
+	/**
+	 * Use the numEntries entries stored at byte offset (a multiple of 8) of
+	 * file, mapped read-only instead of copied, so processes that map the same
+	 * file share its pages. The entries must not be changed while mapped;
+	 * Resize or Read replace the mapping with private memory. Get reads one
+	 * word past an entry, so the file must hold a spare word after the last.
+	 */
+	bool Map(const char *file, uint64_t offset, uint64_t numEntries, bool prefetch = false);
+	bool IsMapped() const { return mapping != 0; }
 private:
+	static void ReplaceBits(uint64_t *word, uint64_t mask, uint64_t bits);
+	void Release();
 	uint64_t *mem;
 	uint64_t entries;
 	uint64_t memorySize;
+	// the file mapping mem points into, if any
+	uint8_t *mapping;
+	uint64_t mappingSize;
+	int mappingFD;
 };
 
 template <uint64_t numBits>
 NBitArray<numBits>::NBitArray(uint64_t numEntries)
-:entries(numEntries), memorySize(((entries*numBits+63)/64))
+:entries(numEntries), memorySize(((entries*numBits+63)/64)), mapping(0)
 {
 	static_assert(numBits >= 1 && numBits <= 64, "numBits out of bounds!");
 
@@ -55,7 +86,7 @@ NBitArray<numBits>::NBitArray(uint64_t numEntries)
 
 template <uint64_t numBits>
 NBitArray<numBits>::NBitArray(const char *file)
-:mem(0)
+:mem(0), mapping(0)
 {
 	static_assert(numBits >= 1 && numBits <= 64, "numBits out of bounds!");
 	Read(file);
@@ -63,6 +94,7 @@ NBitArray<numBits>::NBitArray(const char *file)
 
 template <uint64_t numBits>
 NBitArray<numBits>::NBitArray(const NBitArray &copyMe)
+:mapping(0)
 {
 	entries = copyMe.entries;
 	memorySize = copyMe.memorySize;
@@ -74,7 +106,18 @@ NBitArray<numBits>::NBitArray(const NBitArray &copyMe)
 template <uint64_t numBits>
 NBitArray<numBits>::~NBitArray()
 {
-	delete [] mem;
+	Release();
+}
+
+template <uint64_t numBits>
+void NBitArray<numBits>::Release()
+{
+	if (mapping)
+		CloseMMap(mapping, mappingSize, mappingFD);
+	else
+		delete [] mem;
+	mapping = 0;
+	mem = 0;
 }
 
 template <uint64_t numBits>
@@ -82,7 +125,7 @@ NBitArray<numBits> &NBitArray<numBits>::operator=(const NBitArray &copyMe)
 {
 	if (this == &copyMe)
 		return *this;
-	delete mem;
+	Release();
 	entries = copyMe.entries;
 	memorySize = copyMe.memorySize;
 	mem = new uint64_t[memorySize];
@@ -107,7 +150,7 @@ void NBitArray<numBits>::Resize(uint64_t newMaxEntries)
 {
 	entries = newMaxEntries;
 	memorySize = ((entries*numBits+63)/64);
-	delete [] mem;
+	Release();
 	mem = new uint64_t[memorySize];
 }
 
@@ -141,7 +184,7 @@ bool NBitArray<numBits>::Read(FILE *f)
 	{
 		entries = e1;
 		memorySize = m1;
-		delete [] mem;
+		Release();
 		mem = new uint64_t[memorySize];
 		success = success&&(fread(mem, sizeof(uint64_t), memorySize, f) == memorySize);
 	}
@@ -176,6 +219,31 @@ bool NBitArray<numBits>::Read(const char *file)
 	return result;
 }
 
+template <uint64_t numBits>
+bool NBitArray<numBits>::Map(const char *file, uint64_t offset, uint64_t numEntries, bool prefetch)
+{
+	uint64_t size;
+	int fd;
+	uint64_t words = (numEntries*numBits+63)/64;
+	uint8_t *m = GetReadOnlyMMAP(file, size, fd);
+	if (m == 0)
+		return false;
+	if (offset%8 != 0 || size < offset+(words+1)*sizeof(uint64_t))
+	{
+		CloseMMap(m, size, fd);
+		return false;
+	}
+	AdviseRandomMMAP(m, size, prefetch);
+	Release();
+	mapping = m;
+	mappingSize = size;
+	mappingFD = fd;
+	mem = (uint64_t*)(m+offset);
+	entries = numEntries;
+	memorySize = words;
+	return true;
+}
+
 template <uint64_t numBits>
 uint64_t NBitArray<numBits>::Get(uint64_t index) const
 {
@@ -207,6 +275,48 @@ void NBitArray<numBits>::Set(uint64_t index, uint64_t val)
 	//	result = ((mem[offset1+1]&bitMask2)<<bitCount2) | result;
 }
 
+template <uint64_t numBits>
+bool NBitArray<numBits>::SetMin(uint64_t index, uint64_t val)
+{
+	const uint64_t valueMask = (numBits == 64)?~0ull:((1ull<<numBits)-1);
+	uint64_t startingBit = index*numBits;
+	uint64_t offset1 = startingBit/64;
+	uint64_t bitOffset1 = startingBit&0x3F; // same as mod 64
+	val &= valueMask;
+	if (bitOffset1+numBits <= 64)
+	{
+		uint64_t old = __atomic_load_n(&mem[offset1], __ATOMIC_RELAXED);
+		while (true)
+		{
+			if (((old>>bitOffset1)&valueMask) <= val)
+				return false;
+			uint64_t next = (old&~(valueMask<<bitOffset1))|(val<<bitOffset1);
+			if (__atomic_compare_exchange_n(&mem[offset1], &old, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				return true;
+		}
+	}
+
+	// spans two words; the lock keeps both halves of one entry consistent,
+	// while the compare-and-swap on each word protects the neighbours
+	static std::mutex spanLocks[64];
+	std::lock_guard<std::mutex> l(spanLocks[index&63]);
+	if (Get(index) <= val)
+		return false;
+	uint64_t bitCount1 = 64-bitOffset1;
+	ReplaceBits(&mem[offset1], ~0ull<<bitOffset1, val<<bitOffset1);
+	ReplaceBits(&mem[offset1+1], (1ull<<(numBits-bitCount1))-1, val>>bitCount1);
+	return true;
+}
+
+/** Atomically set the masked bits of word to bits. */
+template <uint64_t numBits>
+void NBitArray<numBits>::ReplaceBits(uint64_t *word, uint64_t mask, uint64_t bits)
+{
+	uint64_t old = __atomic_load_n(word, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(word, &old, (old&~mask)|bits, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{ }
+}
+
 template <>
 uint64_t NBitArray<64>::Get(uint64_t index) const;
 template <>
@@ -7,56 +7,125 @@
  */
 
 #include <fstream>
-using std::ifstream;
 using std::ofstream;
 #include <iomanip>
+#include <cctype>
+#include <cstdlib>
+#include <stdint.h>
 #include "ScenarioLoader.h"
+#include "MMapUtil.h"
 #include <assert.h>
 
+namespace {
+/** Cursor over a memory-mapped scenario file; tokens are whitespace separated. */
+struct scenarioReader {
+	const char *next, *end;
+	bool Token(const char *&tok, size_t &len)
+	{
+		while (next < end && isspace((unsigned char)*next))
+			next++;
+		tok = next;
+		while (next < end && !isspace((unsigned char)*next))
+			next++;
+		len = next-tok;
+		return len > 0;
+	}
+	bool Int(int &val)
+	{
+		const char *tok;
+		size_t len;
+		if (!Token(tok, len))
+			return false;
+		bool neg = (*tok == '-');
+		size_t x = (neg||*tok == '+')?1:0;
+		if (x == len)
+			return false;
+		val = 0;
+		for (; x < len; x++)
+		{
+			if (!isdigit((unsigned char)tok[x]))
+				return false;
+			val = val*10+(tok[x]-'0');
+		}
+		if (neg)
+			val = -val;
+		return true;
+	}
+	bool Double(double &val)
+	{
+		const char *tok;
+		size_t len;
+		char buffer[64];
+		if (!Token(tok, len) || len >= sizeof(buffer))
+			return false;
+		memcpy(buffer, tok, len);
+		buffer[len] = 0;
+		char *last;
+		val = strtod(buffer, &last);
+		return last == buffer+len;
+	}
+	bool String(string &val)
+	{
+		const char *tok;
+		size_t len;
+		if (!Token(tok, len))
+			return false;
+		val.assign(tok, len);
+		return true;
+	}
+};
+}
+
 /** 
- * Loads the experiments from the scenario file. 
+ * Loads the experiments from the scenario file. The file is memory-mapped
+ * and parsed in a single pass.
  */
 ScenarioLoader::ScenarioLoader(const char* fname)
 {
 	strncpy(scenName, fname, 1024);
-  ifstream sfile(fname,std::ios::in);
-  
-  float ver;
-  string first;
-  sfile>>first;
+	uint64_t size;
+	int fd;
+	uint8_t *mem = GetReadOnlyMMAP(fname, size, fd);
+	if (mem == 0)
+		return;
 
-  // Check if a version number is given
-  if (first != "version"){
-    ver = 0.0;
-    sfile.seekg(0,std::ios::beg);
-  }
-  else{
-    sfile>>ver;
-  }
+	scenarioReader r;
+	r.next = (const char *)mem;
+	r.end = r.next+size;
 
-  int sizeX = 0, sizeY = 0; 
-  int bucket;
-  string map;  
-  int xs, ys, xg, yg;
-  double dist;
+	// Check if a version number is given
+	double ver = 0.0;
+	string first;
+	const char *start = r.next;
+	if (!r.String(first) || first != "version")
+		r.next = start;
+	else
+		r.Double(ver);
 
-  // Read in & store experiments
-  if (ver==0.0){
-    while(sfile>>bucket>>map>>xs>>ys>>xg>>yg>>dist) {
-      Experiment exp(xs,ys,xg,yg,bucket,dist,map);
-      experiments.push_back(exp);
-    }
-  }
-  else if (ver==1.0){
-    while(sfile>>bucket>>map>>sizeX>>sizeY>>xs>>ys>>xg>>yg>>dist){
-      Experiment exp(xs,ys,xg,yg,sizeX,sizeY,bucket,dist,map);
-      experiments.push_back(exp);
-    }
-  }
-  else{
-    printf("Invalid version number.\n");
-    //assert(0);
-  }
+	int sizeX = 0, sizeY = 0;
+	int bucket;
+	string map;
+	int xs, ys, xg, yg;
+	double dist;
+
+	// Read in & store experiments
+	if (ver == 0.0)
+	{
+		while (r.Int(bucket) && r.String(map) && r.Int(xs) && r.Int(ys) &&
+			   r.Int(xg) && r.Int(yg) && r.Double(dist))
+			experiments.push_back(Experiment(xs,ys,xg,yg,bucket,dist,map));
+	}
+	else if (ver == 1.0)
+	{
+		while (r.Int(bucket) && r.String(map) && r.Int(sizeX) && r.Int(sizeY) &&
+			   r.Int(xs) && r.Int(ys) && r.Int(xg) && r.Int(yg) && r.Double(dist))
+			experiments.push_back(Experiment(xs,ys,xg,yg,sizeX,sizeY,bucket,dist,map));
+	}
+	else {
+		printf("Invalid version number.\n");
+		//assert(0);
+	}
+	CloseMMap(mem, size, fd);
 }
 
 void ScenarioLoader::Save(const char *fname)
@@ -0,0 +1,159 @@
+//
+//  SearchTrace.cpp
+//  hog2 glut
+//
+
+#include "SearchTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+const char traceMagic[8] = {'H', 'O', 'G', 'T', 'R', 'C', '1', 0};
+
+struct traceHeader {
+	char magic[8];
+	uint32_t recordSize;
+	uint32_t threads;
+	uint64_t records;
+};
+
+struct traceBuffer {
+	std::vector<SearchTraceRecord> records;
+	uint64_t written; // total records written; the ring holds the last ones
+	uint16_t thread;
+};
+
+struct traceRegistry {
+	std::mutex lock;
+	std::vector<std::unique_ptr<traceBuffer>> buffers;
+	size_t capacity = 1<<16;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+};
+
+traceRegistry &Registry()
+{
+	static traceRegistry registry;
+	return registry;
+}
+
+thread_local traceBuffer *localBuffer = 0;
+
+traceBuffer *NewBuffer()
+{
+	traceRegistry &r = Registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	traceBuffer *b = new traceBuffer;
+	b->records.resize(r.capacity);
+	b->written = 0;
+	b->thread = (uint16_t)r.buffers.size();
+	r.buffers.push_back(std::unique_ptr<traceBuffer>(b));
+	return b;
+}
+
+}
+
+void SearchTrace::SetCapacity(size_t records)
+{
+	size_t capacity = 1;
+	while (capacity < records)
+		capacity <<= 1;
+	traceRegistry &r = Registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	r.capacity = capacity;
+}
+
+void SearchTrace::Record(tTraceDirection direction, uint8_t queue, double g, double h, double f, uint64_t hash)
+{
+	traceBuffer *b = localBuffer;
+	if (b == 0)
+		b = localBuffer = NewBuffer();
+	// capacity is a power of two
+	SearchTraceRecord &r = b->records[b->written&(b->records.size()-1)];
+	r.time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-Registry().start).count();
+	r.hash = hash;
+	r.g = g;
+	r.h = h;
+	r.f = f;
+	r.direction = direction;
+	r.queue = queue;
+	r.thread = b->thread;
+	r.reserved = 0;
+	b->written++;
+}
+
+void SearchTrace::Clear()
+{
+	traceRegistry &r = Registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	for (auto &b : r.buffers)
+		b->written = 0;
+	r.start = std::chrono::steady_clock::now();
+}
+
+uint64_t SearchTrace::Size()
+{
+	traceRegistry &r = Registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	uint64_t count = 0;
+	for (auto &b : r.buffers)
+		count += std::min<uint64_t>(b->written, b->records.size());
+	return count;
+}
+
+bool SearchTrace::Dump(const char *filename)
+{
+	std::vector<SearchTraceRecord> all;
+	traceHeader h;
+	{
+		traceRegistry &r = Registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+		for (auto &b : r.buffers)
+		{
+			uint64_t size = b->records.size();
+			uint64_t first = (b->written > size)?(b->written-size):0;
+			for (uint64_t x = first; x < b->written; x++)
+				all.push_back(b->records[x&(size-1)]);
+		}
+		h.threads = (uint32_t)r.buffers.size();
+	}
+	std::stable_sort(all.begin(), all.end(),
+					 [](const SearchTraceRecord &a, const SearchTraceRecord &b) { return a.time < b.time; });
+	memcpy(h.magic, traceMagic, sizeof(h.magic));
+	h.recordSize = sizeof(SearchTraceRecord);
+	h.records = all.size();
+
+	FILE *f = fopen(filename, "wb");
+	if (f == 0)
+		return false;
+	bool ok = (fwrite(&h, sizeof(h), 1, f) == 1);
+	if (ok && all.size() > 0)
+		ok = (fwrite(&all[0], sizeof(SearchTraceRecord), all.size(), f) == all.size());
+	return (fclose(f) == 0) && ok;
+}
+
+bool SearchTrace::Load(const char *filename, std::vector<SearchTraceRecord> &records)
+{
+	records.resize(0);
+	FILE *f = fopen(filename, "rb");
+	if (f == 0)
+		return false;
+	traceHeader h;
+	bool ok = (fread(&h, sizeof(h), 1, f) == 1 &&
+			   memcmp(h.magic, traceMagic, sizeof(h.magic)) == 0 &&
+			   h.recordSize == sizeof(SearchTraceRecord));
+	if (ok)
+	{
+		records.resize(h.records);
+		if (h.records > 0)
+			ok = (fread(&records[0], sizeof(SearchTraceRecord), h.records, f) == h.records);
+	}
+	fclose(f);
+	if (!ok)
+		records.resize(0);
+	return ok;
+}
@@ -0,0 +1,62 @@
+//
+//  SearchTrace.h
+//  hog2 glut
+//
+//  Optional trace of node expansions for the bidirectional searches.
+//  Build with TRACE=1 (which defines SEARCH_TRACE) to record expansions;
+//  otherwise SEARCH_TRACE_EXPANSION expands to nothing and its arguments
+//  are never evaluated.
+//
+
+#ifndef SEARCH_TRACE_H
+#define SEARCH_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum tTraceDirection {
+	kTraceForward = 0,
+	kTraceBackward = 1
+};
+
+/** One expansion; 48 bytes, written to the dump file as is. */
+struct SearchTraceRecord {
+	uint64_t time; // nanoseconds since the trace was started
+	uint64_t hash; // state hash of the expanded node
+	double g, h;
+	double f; // priority the node was expanded with
+	uint8_t direction; // tTraceDirection
+	uint8_t queue; // open list the node came from (algorithm specific)
+	uint16_t thread; // index of the recording thread
+	uint32_t reserved;
+};
+
+/**
+ * Each thread records into its own ring buffer, so recording takes no locks;
+ * once a buffer is full the oldest records are overwritten. Only registering
+ * a new thread, Clear() and Dump() lock, and Clear()/Dump() must not run
+ * while searches are recording.
+ */
+namespace SearchTrace {
+	/** Records kept per thread (rounded up to a power of two). Applies to buffers created later. */
+	void SetCapacity(size_t records);
+	void Record(tTraceDirection direction, uint8_t queue, double g, double h, double f, uint64_t hash);
+	/** Drop all records and restart the clock. */
+	void Clear();
+	/** Number of records currently kept over all threads. */
+	uint64_t Size();
+	/** Write all kept records, ordered by time. Returns false on error. */
+	bool Dump(const char *filename);
+	/** Read a file written by Dump. Returns false if it is not a trace. */
+	bool Load(const char *filename, std::vector<SearchTraceRecord> &records);
+}
+
+#ifdef SEARCH_TRACE
+#define SEARCH_TRACE_EXPANSION(direction, queue, g, h, f, hash) \
+	SearchTrace::Record(direction, queue, g, h, f, hash)
+#else
+#define SEARCH_TRACE_EXPANSION(direction, queue, g, h, f, hash) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+//
+//  WorkerPool.h
+//  hog2 glut
+//
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* WorkerPool
+ *
+ * A fixed set of persistent threads that run the iterations of a loop in
+ * parallel. The calling thread works on the loop as well, so a pool of one
+ * thread runs everything inline. Idle workers spin for a short while before
+ * going to sleep, so issuing many small batches in a row (e.g. one per node
+ * expansion) does not pay for a thread wakeup on each batch.
+ */
+class WorkerPool {
+public:
+	WorkerPool(int numThreads = 1);
+	~WorkerPool();
+	int GetNumThreads() const { return (int)workers.size()+1; }
+	/* Calls func(index, threadID) for every index in [0, count) and returns
+	 * once all calls have finished. threadID is 0 for the calling thread. */
+	void ParallelFor(size_t count, const std::function<void(size_t, int)> &func);
+private:
+	void Worker(int threadID);
+	void RunTasks(int threadID);
+
+	std::vector<std::thread> workers;
+	std::function<void(size_t, int)> task;
+	size_t taskCount;
+	std::atomic<size_t> nextTask;
+	std::atomic<int> busyWorkers;
+	std::atomic<uint64_t> generation;
+	std::atomic<bool> done;
+	std::mutex lock;
+	std::condition_variable wake;
+};
+
+inline WorkerPool::WorkerPool(int numThreads)
+:taskCount(0), nextTask(0), busyWorkers(0), generation(0), done(false)
+{
+	for (int x = 1; x < numThreads; x++)
+		workers.push_back(std::thread(&WorkerPool::Worker, this, x));
+}
+
+inline WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> l(lock);
+		done = true;
+	}
+	wake.notify_all();
+	for (auto &t : workers)
+		t.join();
+}
+
+inline void WorkerPool::ParallelFor(size_t count, const std::function<void(size_t, int)> &func)
+{
+	if (workers.size() == 0 || count < 2)
+	{
+		for (size_t x = 0; x < count; x++)
+			func(x, 0);
+		return;
+	}
+	task = func;
+	taskCount = count;
+	nextTask = 0;
+	busyWorkers = (int)workers.size();
+	{
+		std::lock_guard<std::mutex> l(lock);
+		generation++;
+	}
+	wake.notify_all();
+	RunTasks(0);
+	// every worker has to check in before task can be replaced by the next batch
+	while (busyWorkers.load() != 0)
+		std::this_thread::yield();
+}
+
+inline void WorkerPool::RunTasks(int threadID)
+{
+	for (size_t x = nextTask++; x < taskCount; x = nextTask++)
+		task(x, threadID);
+}
+
+inline void WorkerPool::Worker(int threadID)
+{
+	const int spinLimit = 1024;
+	uint64_t seen = 0;
+	while (true)
+	{
+		for (int x = 0; x < spinLimit && generation.load() == seen && !done; x++)
+			std::this_thread::yield();
+		if (generation.load() == seen && !done)
+		{
+			std::unique_lock<std::mutex> l(lock);
+			wake.wait(l, [&]{ return generation.load() != seen || done; });
+		}
+		if (done)
+			return;
+		seen = generation.load();
+		RunTasks(threadID);
+		busyWorkers--;
+	}
+}
+
+#endif